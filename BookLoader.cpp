@@ -0,0 +1,123 @@
+﻿// BookLoader.cpp — поток чтения книги и очередь текста для UI
+#include "BookLoader.h"
+#include "FileLoader.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <system_error>
+
+namespace manuscripta {
+
+    BookLoader::BookLoader(std::function<void()> notify, size_t chunkBytes)
+        : _notify(std::move(notify)),
+        _chunkBytes(std::max<size_t>(chunkBytes, 4096)),
+        _maxQueued(_chunkBytes * 4)
+    {
+    }
+
+    BookLoader::~BookLoader()
+    {
+        Cancel();
+    }
+
+    uint64_t BookLoader::Start(const std::wstring& path)
+    {
+        Cancel();
+        _cancel = CancelSource();
+
+        std::error_code ec;
+        const uint64_t bytes = std::filesystem::file_size(std::filesystem::path(path), ec);
+        _thread = std::thread(&BookLoader::run, this, path, _cancel.Token());
+        return ec ? 0 : bytes;
+    }
+
+    void BookLoader::Cancel()
+    {
+        _cancel.Cancel();
+        {
+            // под замком: поток проверяет отмену в том же ожидании
+            std::lock_guard<std::mutex> lock(_mutex);
+            _drained.notify_all();
+        }
+        if (_thread.joinable()) _thread.join();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _file.reset();
+        _mappedTaken = _mapped = 0;
+        _queued.clear();
+        _final = false;
+        _error.clear();
+        _signalled = false;
+    }
+
+    bool BookLoader::Take(Chunk& out)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _signalled = false;
+            if (_mapped == _mappedTaken && _queued.empty() && !_final) return false;
+
+            out.file = _file;
+            out.mapped = _file ? _file->Bytes().substr(_mappedTaken, _mapped - _mappedTaken)
+                : std::string_view();
+            _mappedTaken = _mapped;
+            if (_final) _file.reset();      // дальше отображение держит читалка
+            out.text.clear();
+            out.text.swap(_queued);         // буфер UI пойдёт под следующий текст
+            out.final = _final;
+            out.error = std::move(_error);
+            _final = false;
+            _error.clear();
+        }
+        _drained.notify_all();
+        return true;
+    }
+
+    void BookLoader::signal(std::unique_lock<std::mutex>& lock)
+    {
+        const bool first = !_signalled;
+        _signalled = true;
+        lock.unlock();
+        if (first && _notify) _notify();
+    }
+
+    void BookLoader::run(std::wstring path, CancelToken cancel)
+    {
+        std::wstring error;
+        try {
+            auto file = std::make_shared<const MappedFile>(path);
+            file->AdviseSequential();
+            const char* const base = file->Bytes().data();
+            bool copying = false;           // текст уже перекодировался — дальше только копии
+            streamTextFileUtf8(*file, [&](std::string_view text, bool mapped) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                // и отображённое UI разметит разом — держим его впереди
+                // не больше, чем копий
+                _drained.wait(lock, [&] {
+                    return _mapped - _mappedTaken + _queued.size() < _maxQueued || cancel.IsCancelled();
+                    });
+                if (cancel.IsCancelled()) return false;
+                copying = copying || !mapped;
+                if (copying) _queued.append(text);
+                else {
+                    _file = file;
+                    _mapped = size_t(text.data() + text.size() - base);
+                }
+                signal(lock);
+                return true;
+                }, _chunkBytes);
+        }
+        catch (const std::exception& e) {
+            if (!utf8ToWide(e.what(), error) || error.empty())
+                error = L"Cannot read file";
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (cancel.IsCancelled()) return;
+        _final = true;
+        _error = std::move(error);
+        signal(lock);
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,78 @@
+﻿#pragma once
+// BookLoader.h — потоковая загрузка книги в фоне.  Поток отображает файл
+// и проходит его блоками (streamTextFileUtf8): книга в UTF-8 только
+// проверяется и уходит читалке прямо из отображения, без копии; иначе
+// текст перекодируется в UTF-8 (так его хранит читалка) и копится в
+// очереди.  UI-поток по сигналу notify забирает накопленное через Take()
+// и дописывает в читалку — первые кадры видны, пока остальная книга ещё
+// читается.  Очередь ограничена: поток ждёт, пока UI заберёт текст, так
+// что сверх самой книги в памяти — несколько блоков.
+#include "CancelToken.h"
+#include "MappedFile.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace manuscripta {
+
+    class BookLoader
+    {
+    public:
+        struct Chunk
+        {
+            // продолжение книги: сначала mapped — UTF-8 прямо из
+            // отображения file (держать file, пока нужен текст), за ним
+            // text — перекодированное
+            std::shared_ptr<const MappedFile> file;
+            std::string_view mapped;
+            std::string  text;
+            bool         final = false;     // дальше текста не будет
+            std::wstring error;             // не пусто — чтение прервала ошибка
+        };
+
+        // notify зовётся из потока загрузки, когда в очереди появилось
+        // новое; пока UI не позвал Take(), повторно не зовётся
+        BookLoader(std::function<void()> notify, size_t chunkBytes);
+        ~BookLoader();                      // = Cancel()
+        BookLoader(const BookLoader&) = delete;
+        BookLoader& operator=(const BookLoader&) = delete;
+
+        // Прошлая загрузка отменяется.  Возвращает размер файла в байтах —
+        // примерно столько займёт перекодированный текст (для reserve);
+        // 0 — неизвестен
+        uint64_t Start(const std::wstring& path);
+        // Остановить поток и дождаться его; недобранный текст выбрасывается
+        void Cancel();
+
+        // Забрать всё накопленное (out перезаписывается, его буфер
+        // переходит в очередь).  false — забирать нечего.
+        bool Take(Chunk& out);
+
+    private:
+        void run(std::wstring path, CancelToken cancel);
+        void signal(std::unique_lock<std::mutex>& lock);
+
+        std::function<void()> _notify;
+        size_t       _chunkBytes;
+        size_t       _maxQueued;            // байт в очереди, дальше поток ждёт
+        std::thread  _thread;
+        CancelSource _cancel;
+
+        std::mutex              _mutex;
+        std::condition_variable _drained;
+        std::shared_ptr<const MappedFile> _file;
+        size_t       _mappedTaken = 0;      // UI забрал file[0, _mappedTaken)
+        size_t       _mapped = 0;           // поток проверил file[0, _mapped)
+        std::string  _queued;               // перекодированное, идёт за _mapped
+        bool         _final = false;
+        std::wstring _error;
+        bool         _signalled = false;    // notify был, Take ещё нет
+    };
+
+} // namespace manuscripta
@@ -0,0 +1,117 @@
+﻿// CancelToken.cpp — флаг отмены с подписчиками
+#include "CancelToken.h"
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace manuscripta {
+
+    struct CancelToken::State
+    {
+        std::mutex              mutex;
+        std::condition_variable done;
+        std::map<uint64_t, std::function<void()>> callbacks;
+        uint64_t        nextId = 1;
+        bool            cancelled = false;
+        bool            running = false;    // Cancel() сейчас вызывает колбэки
+        std::thread::id runner;
+    };
+
+    bool CancelToken::IsCancelled() const
+    {
+        if (!_state) return false;
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        return _state->cancelled;
+    }
+
+    uint64_t CancelToken::Subscribe(std::function<void()> onCancel) const
+    {
+        if (!_state || !onCancel) return 0;
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if (!_state->cancelled) {
+                const uint64_t id = _state->nextId++;
+                _state->callbacks.emplace(id, std::move(onCancel));
+                return id;
+            }
+        }
+        onCancel();
+        return 0;
+    }
+
+    void CancelToken::Unsubscribe(uint64_t id) const
+    {
+        if (!_state || !id) return;
+        std::unique_lock<std::mutex> lock(_state->mutex);
+        _state->callbacks.erase(id);
+        // колбэк мог быть уже забран Cancel() — ждём, пока он отработает
+        if (_state->runner != std::this_thread::get_id())
+            _state->done.wait(lock, [this] { return !_state->running; });
+    }
+
+    bool CancelToken::WaitFor(std::chrono::milliseconds timeout) const
+    {
+        if (!_state) {
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool cancelled = false;
+        CancelScope wake(*this, [&] {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cancelled = true;
+            }
+            cv.notify_all();
+            });
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_for(lock, timeout, [&] { return cancelled; });
+        return cancelled;
+    }
+
+    CancelSource::CancelSource()
+        : _state(std::make_shared<CancelToken::State>())
+    {
+    }
+
+    CancelToken CancelSource::Token() const
+    {
+        CancelToken t;
+        t._state = _state;
+        return t;
+    }
+
+    bool CancelSource::IsCancelled() const
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        return _state->cancelled;
+    }
+
+    void CancelSource::Cancel()
+    {
+        std::map<uint64_t, std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if (_state->cancelled) return;
+            _state->cancelled = true;
+            _state->running = true;
+            _state->runner = std::this_thread::get_id();
+            callbacks.swap(_state->callbacks);
+        }
+
+        for (auto& kv : callbacks)
+            kv.second();
+
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            _state->running = false;
+            _state->runner = {};
+        }
+        _state->done.notify_all();
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,65 @@
+﻿#pragma once
+// CancelToken.h — отмена фоновой работы.  CancelSource у того, кто
+// решает («читатель ушёл с кадра»), CancelToken — у исполнителя.
+// Исполнитель либо проверяет IsCancelled() между шагами, либо
+// подписывается на отмену, чтобы прервать блокирующий вызов
+// (закрыть HTTP-запрос и т.п.).
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace manuscripta {
+
+    class CancelToken
+    {
+    public:
+        CancelToken() = default;            // никогда не отменяется
+
+        bool IsCancelled() const;
+
+        // onCancel вызывается один раз: сразу (в этом потоке), если
+        // отмена уже была, иначе — в потоке, вызвавшем Cancel().
+        // 0 — подписки нет (токен пустой или уже отменён).
+        uint64_t Subscribe(std::function<void()> onCancel) const;
+        // После возврата колбэк не выполняется и не будет вызван
+        void Unsubscribe(uint64_t id) const;
+
+        // Пауза, которую прерывает отмена (ожидание перед повтором).
+        // true — токен отменён
+        bool WaitFor(std::chrono::milliseconds timeout) const;
+
+    private:
+        friend class CancelSource;
+        struct State;
+        std::shared_ptr<State> _state;
+    };
+
+    class CancelSource
+    {
+    public:
+        CancelSource();
+        CancelToken Token() const;
+        void Cancel();
+        bool IsCancelled() const;
+
+    private:
+        std::shared_ptr<CancelToken::State> _state;
+    };
+
+    // Подписка на время блока
+    class CancelScope
+    {
+    public:
+        CancelScope(const CancelToken& token, std::function<void()> onCancel)
+            : _token(token), _id(token.Subscribe(std::move(onCancel))) {}
+        ~CancelScope() { _token.Unsubscribe(_id); }
+        CancelScope(const CancelScope&) = delete;
+        CancelScope& operator=(const CancelScope&) = delete;
+
+    private:
+        CancelToken _token;
+        uint64_t    _id;
+    };
+
+} // namespace manuscripta
@@ -0,0 +1,83 @@
+﻿// CircuitBreaker.cpp — Closed → Open → HalfOpen → Closed / Open
+#include "CircuitBreaker.h"
+#include <algorithm>
+
+namespace manuscripta {
+
+    CircuitBreaker::CircuitBreaker(const Config& cfg)
+        : _cfg(cfg), _cooldown(cfg.cooldown)
+    {
+        _cfg.failureThreshold = std::max(1u, _cfg.failureThreshold);
+        _cfg.maxCooldown = std::max(_cfg.maxCooldown, _cfg.cooldown);
+        _cooldown = _cfg.cooldown;
+    }
+
+    bool CircuitBreaker::Allow(Clock::time_point now)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        switch (_state)
+        {
+        case State::Closed:
+            return true;
+        case State::Open:
+            if (now < _openUntil) return false;
+            _state = State::HalfOpen;
+            _probeStarted = now;
+            return true;
+        case State::HalfOpen:
+            // проба пропала без исхода — пускаем следующую
+            if (now - _probeStarted < _cooldown) return false;
+            _probeStarted = now;
+            return true;
+        }
+        return false;
+    }
+
+    void CircuitBreaker::Success()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _state = State::Closed;
+        _failures = 0;
+        _cooldown = _cfg.cooldown;
+    }
+
+    bool CircuitBreaker::Failure(Clock::time_point now)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        switch (_state)
+        {
+        case State::Closed:
+            if (++_failures < _cfg.failureThreshold) return false;
+            openLocked(now);
+            return true;
+        case State::HalfOpen:
+            _cooldown = std::min(_cooldown * 2, _cfg.maxCooldown);
+            openLocked(now);
+            return true;
+        case State::Open:
+            return false;                   // ответ запроса, начатого до размыкания
+        }
+        return false;
+    }
+
+    void CircuitBreaker::openLocked(Clock::time_point now)
+    {
+        _state = State::Open;
+        _failures = 0;
+        _openUntil = now + _cooldown;
+        ++_trips;
+    }
+
+    CircuitBreaker::State CircuitBreaker::Current() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _state;
+    }
+
+    uint64_t CircuitBreaker::Trips() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _trips;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,55 @@
+﻿#pragma once
+// CircuitBreaker.h — «предохранитель» сервера сцен.  После
+// failureThreshold сбоев подряд сервер считается лежащим: запросы к
+// нему не отправляются cooldown (разомкнут), затем пропускается один
+// пробный запрос.  Проба удалась — снова замкнут; нет — разомкнут
+// на вдвое больший срок (не дольше maxCooldown).
+//
+// Потокобезопасен: Allow/Success/Failure зовут рабочие потоки загрузки.
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace manuscripta {
+
+    class CircuitBreaker
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        enum class State { Closed, Open, HalfOpen };
+
+        struct Config
+        {
+            unsigned        failureThreshold = 5;
+            Clock::duration cooldown = std::chrono::seconds(15);
+            Clock::duration maxCooldown = std::chrono::minutes(2);
+        };
+
+        explicit CircuitBreaker(const Config& cfg);
+
+        // Можно ли слать запрос сейчас.  true в HalfOpen — это проба:
+        // остальные ждут её исхода (или истечения ещё одного cooldown,
+        // если проба так и не отчиталась — например, отменена)
+        bool Allow(Clock::time_point now = Clock::now());
+        void Success();
+        // true — этот сбой разомкнул цепь
+        bool Failure(Clock::time_point now = Clock::now());
+
+        State    Current() const;
+        uint64_t Trips() const;             // сколько раз размыкался
+
+    private:
+        Config            _cfg;
+        mutable std::mutex _mutex;
+        State             _state = State::Closed;
+        unsigned          _failures = 0;    // подряд, в Closed
+        Clock::duration   _cooldown;        // текущий срок размыкания
+        Clock::time_point _openUntil{};
+        Clock::time_point _probeStarted{};
+        uint64_t          _trips = 0;
+
+        void openLocked(Clock::time_point now);
+    };
+
+} // namespace manuscripta
@@ -0,0 +1,471 @@
+﻿// DiskCache.cpp — кэш файлов с индексом и вытеснением по LRU
+#include "DiskCache.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace manuscripta {
+
+    namespace {
+
+        const char* const INDEX_NAME = "index.txt";
+        const char* const INDEX_HEADER = "manuscripta-cache 1";
+
+        // индекс — целиком в одном файле, поэтому переписываем его не на
+        // каждую запись (квадратично по числу записей), а пачкой
+        const uint64_t INDEX_SAVE_EVERY = 1024;     // изменений
+        const auto     INDEX_SAVE_DELAY = std::chrono::seconds(2);
+
+        // ключ = имя файла: только [0-9A-Za-z_-], чтобы не выйти из каталога
+        bool validKey(const std::string& key)
+        {
+            if (key.empty() || key.size() > 64) return false;
+            for (char c : key)
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                    (c >= 'A' && c <= 'Z') || c == '-' || c == '_'))
+                    return false;
+            return true;
+        }
+
+        bool isTemp(const fs::path& p)
+        {
+            return p.extension() == ".tmp";
+        }
+
+    } // namespace
+
+    DiskCache::~DiskCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            _stop = true;
+        }
+        _queueCv.notify_all();
+        if (_writer.joinable()) _writer.join();
+        Flush();
+    }
+
+    bool DiskCache::Open(const fs::path& dir, uint64_t capacityBytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _entries.clear();
+            _bytes = 0;
+            _tick = 0;
+            _open = false;
+            _dirty = false;
+            _unsaved = 0;
+            _capacity = capacityBytes;
+            _dir = dir;
+
+            std::error_code ec;
+            fs::create_directories(_dir, ec);
+            if (!fs::is_directory(_dir, ec)) return false;
+
+            loadIndexLocked();
+            _open = true;
+            trimLocked();
+            _wakeWriter = false;                // сохраняем сразу
+        }
+        saveIndex(false);
+        return true;
+    }
+
+    bool DiskCache::IsOpen() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _open;
+    }
+
+    void DiskCache::loadIndexLocked()
+    {
+        std::error_code ec;
+
+        // 1. индекс: только записи, чьи файлы на месте
+        std::ifstream in(_dir / INDEX_NAME);
+        std::string line;
+        if (in && std::getline(in, line) && line == INDEX_HEADER)
+        {
+            while (std::getline(in, line))
+            {
+                std::istringstream ls(line);
+                std::string key;
+                uint64_t size = 0, tick = 0;
+                if (!(ls >> key >> size >> tick) || !validKey(key)) continue;
+
+                const uint64_t actual = fs::file_size(_dir / key, ec);
+                if (ec) { touchIndexLocked(); continue; }
+                Entry& e = _entries[key];
+                e.size = actual;
+                e.tick = tick;
+                _bytes += actual;
+                _tick = std::max(_tick, tick);
+            }
+        }
+        in.close();
+
+        // 2. файлы без индекса (упали до сохранения) — самые старые;
+        //    недописанные *.tmp — мусор
+        for (const fs::directory_entry& de : fs::directory_iterator(_dir, ec))
+        {
+            if (!de.is_regular_file(ec)) continue;
+            const fs::path& p = de.path();
+            const std::string name = p.filename().string();
+            if (name == INDEX_NAME) continue;
+            if (isTemp(p)) { fs::remove(p, ec); continue; }
+            if (!validKey(name) || _entries.count(name)) continue;
+
+            const uint64_t size = de.file_size(ec);
+            if (ec) continue;
+            _entries[name] = Entry{ size, 0 };
+            _bytes += size;
+            touchIndexLocked();
+        }
+    }
+
+    void DiskCache::touchIndexLocked()
+    {
+        ++_unsaved;
+        if (!_dirty) {
+            _dirty = true;
+            _dirtySince = Clock::now();
+            _wakeWriter = true;                 // завести таймер сохранения
+        }
+        else if (_unsaved == INDEX_SAVE_EVERY)
+            _wakeWriter = true;                 // пора, не дожидаясь таймера
+    }
+
+    bool DiskCache::takeWakeLocked()
+    {
+        const bool wake = _wakeWriter;
+        _wakeWriter = false;
+        return wake;
+    }
+
+    bool DiskCache::saveIndex(bool ifDue)
+    {
+        std::lock_guard<std::mutex> saving(_saveMutex);
+
+        std::string text;
+        fs::path dir;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_open || !_dirty) return false;
+            if (ifDue && _unsaved < INDEX_SAVE_EVERY &&
+                Clock::now() - _dirtySince < INDEX_SAVE_DELAY)
+                return true;
+
+            text.reserve(32 + _entries.size() * 48);
+            text += INDEX_HEADER;
+            text += '\n';
+            for (const auto& [key, e] : _entries) {
+                text += key;
+                text += ' ';
+                text += std::to_string(e.size);
+                text += ' ';
+                text += std::to_string(e.tick);
+                text += '\n';
+            }
+            dir = _dir;
+            _dirty = false;                     // изменения после снимка снова его поднимут
+            _unsaved = 0;
+        }
+
+        // файл пишем без _mutex: Lookup/Read/Write не ждут диска
+        const fs::path tmp = dir / "index.txt.tmp";
+        bool ok;
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(text.data(), std::streamsize(text.size()));
+            ok = bool(out);
+        }
+        std::error_code ec;
+        if (ok) fs::rename(tmp, dir / INDEX_NAME, ec);
+        if (ok && !ec) return false;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        fs::remove(tmp, ec);
+        if (!_dirty) {                          // не вышло — попробуем позже
+            _dirty = true;
+            _dirtySince = Clock::now();
+        }
+        return true;
+    }
+
+    void DiskCache::Flush()
+    {
+        saveIndex(false);
+    }
+
+    fs::path DiskCache::tempPathLocked()
+    {
+        return _dir / ("w" + std::to_string(++_tmpSeq) + ".tmp");
+    }
+
+    void DiskCache::insertLocked(const std::string& key, uint64_t size)
+    {
+        Entry& e = _entries[key];
+        _bytes -= e.size;                   // 0 для новой записи
+        e.size = size;
+        e.tick = ++_tick;
+        _bytes += size;
+        touchIndexLocked();
+    }
+
+    void DiskCache::eraseLocked(const std::string& key)
+    {
+        auto it = _entries.find(key);
+        if (it == _entries.end()) return;
+        _bytes -= it->second.size;
+        _entries.erase(it);
+        touchIndexLocked();
+
+        // файл может быть открыт читателем (Windows не даст удалить) —
+        // тогда он останется сиротой и будет подобран следующим Open()
+        std::error_code ec;
+        fs::remove(_dir / key, ec);
+    }
+
+    void DiskCache::trimLocked()
+    {
+        if (_bytes <= _capacity) return;
+
+        std::vector<std::pair<uint64_t, std::string>> byAge;
+        byAge.reserve(_entries.size());
+        for (const auto& [key, e] : _entries)
+            byAge.emplace_back(e.tick, key);
+        std::sort(byAge.begin(), byAge.end());
+
+        for (const auto& [tick, key] : byAge)
+        {
+            if (_bytes <= _capacity) break;
+            eraseLocked(key);
+        }
+    }
+
+    bool DiskCache::Lookup(const std::string& key, fs::path& file)
+    {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_open) return false;
+            auto it = _entries.find(key);
+            if (it == _entries.end()) return false;
+            it->second.tick = ++_tick;
+            touchIndexLocked();
+            file = _dir / key;
+            wake = takeWakeLocked();
+        }
+        if (wake) indexChanged();
+        return true;
+    }
+
+    bool DiskCache::Read(const std::string& key, std::string& data)
+    {
+        if (pendingData(key, data)) return true;
+
+        fs::path file;
+        if (!Lookup(key, file)) return false;
+
+        std::ifstream in(file, std::ios::binary);
+        if (in) {
+            std::ostringstream ss;
+            ss << in.rdbuf();
+            if (in.good() || in.eof()) {
+                data = std::move(ss).str();
+                return true;
+            }
+        }
+        Remove(key);                        // файл пропал или битый
+        return false;
+    }
+
+    bool DiskCache::Write(const std::string& key, std::string_view data)
+    {
+        if (!validKey(key)) return false;
+
+        fs::path tmp;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_open) return false;
+            tmp = tempPathLocked();
+        }
+
+        // сам файл пишем без блокировки
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), std::streamsize(data.size()));
+            if (!out) {
+                out.close();
+                std::error_code ec;
+                fs::remove(tmp, ec);
+                return false;
+            }
+        }
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::error_code ec;
+            fs::rename(tmp, _dir / key, ec);
+            if (ec) { fs::remove(tmp, ec); return false; }
+            insertLocked(key, data.size());
+            trimLocked();
+            wake = takeWakeLocked();
+        }
+        if (wake) indexChanged();
+        return true;
+    }
+
+    void DiskCache::WriteAsync(std::string key, std::string data)
+    {
+        if (!validKey(key) || !IsOpen()) return;
+
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        if (_stop) return;
+        for (auto& item : _queue)
+            if (item.first == key) {            // ещё не записан — заменить
+                item.second = std::move(data);
+                return;
+            }
+        _queue.emplace_back(std::move(key), std::move(data));
+        startWriterLocked();
+        _queueCv.notify_one();
+    }
+
+    void DiskCache::startWriterLocked()
+    {
+        if (!_writer.joinable())
+            _writer = std::thread(&DiskCache::writerLoop, this);
+    }
+
+    // Индекс изменился впервые после сохранения или накопил
+    // INDEX_SAVE_EVERY изменений — будим фоновый поток
+    void DiskCache::indexChanged()
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        if (_stop) return;                      // сохранит деструктор
+        _indexChanged = true;
+        startWriterLocked();
+        _queueCv.notify_one();
+    }
+
+    void DiskCache::writerLoop()
+    {
+        std::unique_lock<std::mutex> lock(_queueMutex);
+        bool indexPending = false;              // индекс ждёт своего срока
+        for (;;)
+        {
+            auto ready = [this] { return _stop || _indexChanged || !_queue.empty(); };
+            if (indexPending) _queueCv.wait_for(lock, INDEX_SAVE_DELAY, ready);
+            else _queueCv.wait(lock, ready);
+            _indexChanged = false;
+
+            if (!_queue.empty())
+            {
+                // элемент остаётся в очереди до конца записи — его видит Read()
+                _writing = true;
+                const std::string key = _queue.front().first;
+                const std::string data = _queue.front().second;
+                lock.unlock();
+                Write(key, data);
+                lock.lock();
+                _queue.pop_front();
+                _writing = false;
+                if (_queue.empty()) _idleCv.notify_all();
+            }
+            else if (_stop) return;             // всё записано; индекс — в деструкторе
+
+            lock.unlock();
+            indexPending = saveIndex(true);
+            lock.lock();
+        }
+    }
+
+    void DiskCache::WaitIdle()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            _idleCv.wait(lock, [this] { return _queue.empty() && !_writing; });
+        }
+        Flush();
+    }
+
+    bool DiskCache::pendingData(const std::string& key, std::string& data)
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        for (const auto& item : _queue)
+            if (item.first == key) {
+                data = item.second;
+                return true;
+            }
+        return false;
+    }
+
+    void DiskCache::Remove(const std::string& key)
+    {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            eraseLocked(key);
+            wake = takeWakeLocked();
+        }
+        if (wake) indexChanged();
+    }
+
+    void DiskCache::SetCapacity(uint64_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _capacity = bytes;
+            trimLocked();
+            _wakeWriter = false;                // сохраняем сразу
+        }
+        saveIndex(false);
+    }
+
+    uint64_t DiskCache::Capacity() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _capacity;
+    }
+
+    uint64_t DiskCache::Bytes() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _bytes;
+    }
+
+    size_t DiskCache::Count() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+    fs::path defaultCacheDirectory()
+    {
+        fs::path base;
+#ifdef _WIN32
+        wchar_t* local = nullptr;
+        size_t len = 0;
+        if (_wdupenv_s(&local, &len, L"LOCALAPPDATA") == 0 && local) {
+            base = local;
+            std::free(local);
+        }
+        if (!base.empty()) return base / L"Manuscripta" / L"cache";
+#else
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+            return fs::path(xdg) / "manuscripta";
+        if (const char* home = std::getenv("HOME"); home && *home)
+            return fs::path(home) / ".cache" / "manuscripta";
+#endif
+        std::error_code ec;
+        base = fs::temp_directory_path(ec);
+        return base / "Manuscripta" / "cache";
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,123 @@
+﻿#pragma once
+// DiskCache.h — постоянный кэш на диске: ключ → файл в одном каталоге.
+// Ключи — короткие строки ("img-<hash>", "scene-<hash>"), имена файлов
+// совпадают с ключами.  Индекс (размер + отметка последнего обращения)
+// лежит рядом в "index.txt"; при превышении лимита удаляются давно
+// не читанные записи.  Индекс пишется не на каждое изменение, а
+// фоновым потоком — раз в несколько секунд или тысячу изменений, —
+// плюс в Flush/WaitIdle/деструкторе; после падения потерянные записи
+// подбирает Open() как самые старые.  Только std::filesystem — без Win32, так что
+// модуль собирается и проверяется и на Linux.
+//
+// Потокобезопасен: к кэшу обращаются рабочие потоки загрузки.
+// WriteAsync отдаёт запись собственному фоновому потоку; деструктор
+// дописывает очередь до конца.
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace manuscripta {
+
+    class DiskCache
+    {
+    public:
+        DiskCache() = default;
+        ~DiskCache();
+        DiskCache(const DiskCache&) = delete;
+        DiskCache& operator=(const DiskCache&) = delete;
+
+        // Создать каталог при необходимости и прочитать индекс.
+        // Файлы без записи в индексе подхватываются как самые старые.
+        bool Open(const std::filesystem::path& dir, uint64_t capacityBytes);
+        bool IsOpen() const;
+
+        // Путь к файлу записи; false — записи нет.  Отмечает обращение.
+        // Записи из очереди WriteAsync здесь ещё не видны.
+        bool Lookup(const std::string& key, std::filesystem::path& file);
+        // Содержимое записи целиком; false — нет или не прочиталось
+        bool Read(const std::string& key, std::string& data);
+
+        // Записать через временный файл + rename (читатель не увидит
+        // половину файла)
+        bool Write(const std::string& key, std::string_view data);
+        // То же в фоновом потоке; Read() видит запись сразу
+        void WriteAsync(std::string key, std::string data);
+        // Дождаться, пока очередь WriteAsync опустеет, и сохранить индекс
+        void WaitIdle();
+        void Remove(const std::string& key);
+
+        void     SetCapacity(uint64_t bytes);
+        uint64_t Capacity() const;
+        uint64_t Bytes() const;
+        size_t   Count() const;
+
+        // Сохранить индекс (иначе его сохранит фоновый поток или деструктор)
+        void Flush();
+
+    private:
+        struct Entry
+        {
+            uint64_t size = 0;
+            uint64_t tick = 0;          // больше — свежее
+        };
+
+        using Clock = std::chrono::steady_clock;
+
+        mutable std::mutex _mutex;
+        std::filesystem::path _dir;
+        std::unordered_map<std::string, Entry> _entries;
+        uint64_t _bytes = 0;
+        uint64_t _capacity = 0;
+        uint64_t _tick = 0;
+        uint64_t _tmpSeq = 0;
+        bool     _open = false;
+        bool     _dirty = false;            // индекс на диске устарел
+        uint64_t _unsaved = 0;              // изменений с последнего сохранения
+        Clock::time_point _dirtySince;
+        bool     _wakeWriter = false;       // сообщить фоновому потоку об индексе
+
+        std::mutex _saveMutex;              // одно сохранение индекса за раз
+
+        // очередь WriteAsync (свой мьютекс: запись файла идёт без _mutex)
+        std::mutex              _queueMutex;
+        std::condition_variable _queueCv;
+        std::condition_variable _idleCv;
+        std::deque<std::pair<std::string, std::string>> _queue;
+        std::thread             _writer;
+        bool                    _writing = false;
+        bool                    _stop = false;
+        bool                    _indexChanged = false;
+
+        void writerLoop();
+        void startWriterLocked();           // под _queueMutex
+        void indexChanged();
+        bool pendingData(const std::string& key, std::string& data);
+        // Снимок индекса под _mutex, файл — без блокировки.  ifDue —
+        // только если пора (по времени или числу изменений).
+        // Возвращает true, если индекс остался несохранённым.
+        bool saveIndex(bool ifDue);
+
+        // под _mutex
+        void insertLocked(const std::string& key, uint64_t size);
+        void eraseLocked(const std::string& key);
+        void trimLocked();
+        void touchIndexLocked();
+        bool takeWakeLocked();
+        void loadIndexLocked();
+        std::filesystem::path tempPathLocked();
+    };
+
+    // Каталог кэша по умолчанию: %LOCALAPPDATA%\Manuscripta\cache на
+    // Windows, $XDG_CACHE_HOME/manuscripta (~/.cache/manuscripta) на
+    // Linux; без переменных окружения — во временном каталоге
+    std::filesystem::path defaultCacheDirectory();
+
+} // namespace manuscripta
@@ -1,13 +1,14 @@
 ﻿// FileLoader.cpp — implementation of manuscripta::loadTextFile*
 #define WIN32_LEAN_AND_MEAN
 #include "FileLoader.h"
-#include <windows.h>
+#include "MappedFile.h"
+#include "Utf8.h"
+#include <algorithm>
 #include <stdexcept>
-#include <fstream>
-#include <sstream>
+#include <string>
+#ifdef _WIN32
 #include <windows.h>
 #include <commdlg.h>
-#include <string>
 
 std::wstring selectTxtFile(HWND owner)
 {
@@ -25,42 +26,129 @@ std::wstring selectTxtFile(HWND owner)
 
     return GetOpenFileNameW(&ofn) ? std::wstring(fileBuf) : std::wstring();
 }
+#endif
 namespace manuscripta {
 
 
-    static std::string readBinary(const std::wstring& path) {
-        std::ifstream fs(path, std::ios::binary);
-        if (!fs) throw std::runtime_error("Cannot open file");
-        std::ostringstream oss;
-        oss << fs.rdbuf();
-        return oss.str();
+    // Decoders for loadTextFileW / streamTextFileUtf8; out is overwritten.
+    // UTF-8 goes through our own single-pass validator (vectorized ASCII
+    // runs, see Utf8.h) on every platform: it beats the two-pass
+    // MultiByteToWideChar(MB_ERR_INVALID_CHARS) size-then-convert dance.
+    static bool decodeUtf8(std::string_view src, std::wstring& out, bool strict) {
+        if (strict) return utf8ToWide(src, out);
+        out.clear();
+        utf8ToWideLossy(src, out);
+        return true;
+    }
+
+    // UTF-8 / ANSI text never has more UTF-16 units than bytes, so on
+    // Windows one MultiByteToWideChar call is enough.
+#ifdef _WIN32
+    static void decodeAnsi(std::string_view src, std::wstring& out) {
+        out.resize(src.size());
+        if (src.empty()) return;
+        int n = MultiByteToWideChar(CP_ACP, 0,
+            src.data(), static_cast<int>(src.size()), out.data(), static_cast<int>(out.size()));
+        out.resize(n);
+    }
+
+    // A DBCS lead byte cut off at the end of a chunk goes to the next one
+    static size_t ansiCompletePrefix(std::string_view src) {
+        CPINFO info{};
+        if (!GetCPInfo(CP_ACP, &info) || info.MaxCharSize == 1) return src.size();
+        size_t i = 0;
+        while (i < src.size()) {
+            if (!IsDBCSLeadByte(static_cast<BYTE>(src[i]))) { ++i; continue; }
+            if (i + 1 == src.size()) return i;
+            i += 2;
+        }
+        return src.size();
+    }
+#else
+    static void decodeAnsi(std::string_view src, std::wstring& out) {
+        out = cp1251ToWide(src);
+    }
+
+    static size_t ansiCompletePrefix(std::string_view src) {
+        return src.size();              // Windows-1251 is single-byte
+    }
+#endif
+
+    bool decodeBookBytes(std::string_view bytes, bool utf8, std::wstring& out) {
+        if (utf8) return decodeUtf8(bytes, out, true);
+        decodeAnsi(bytes, out);
+        return true;
     }
 
     std::string loadTextFileA(const std::wstring& filePath) {
-        return readBinary(filePath); // raw bytes -> caller decides encoding
+        MappedFile file(filePath);
+        return std::string(file.Bytes()); // raw bytes -> caller decides encoding
     }
 
     std::wstring loadTextFileW(const std::wstring& filePath) {
-        std::string raw = readBinary(filePath);
-
-        // Try interpret as UTF‑8 first
-        bool usedUtf8 = true;
-        int lenW = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS,
-            raw.data(), static_cast<int>(raw.size()), nullptr, 0);
-        if (lenW == 0) {
-            // Fallback to system codepage
-            usedUtf8 = false;
-            lenW = MultiByteToWideChar(CP_ACP, 0,
-                raw.data(), static_cast<int>(raw.size()), nullptr, 0);
-            if (lenW == 0) throw std::runtime_error("Encoding conversion failed");
-        }
+        MappedFile file(filePath);          // decoded straight from the mapping
+        const std::string_view raw = file.Bytes();
+        if (raw.empty()) return {};
 
-        std::wstring w(lenW, L'\0');
-        UINT codePage = usedUtf8 ? CP_UTF8 : CP_ACP;
-        DWORD flags = usedUtf8 ? MB_ERR_INVALID_CHARS : 0;
-        MultiByteToWideChar(codePage, flags,
-            raw.data(), static_cast<int>(raw.size()), w.data(), lenW);
+        // Try interpret as UTF-8 first: validated and converted in one pass
+        std::wstring w;
+        if (decodeUtf8(raw, w, true)) return w;
+
+        // Fallback to system codepage (Windows-1251 off Windows: what
+        // CP_ACP is on the authors' machines)
+        decodeAnsi(raw, w);
+        if (w.empty()) throw std::runtime_error("Encoding conversion failed");
         return w;
     }
 
+    bool streamTextFileUtf8(const MappedFile& file,
+        const std::function<bool(std::string_view, bool)>& onText, size_t chunkBytes) {
+        const std::string_view bytes = file.Bytes();
+        chunkBytes = std::max<size_t>(chunkBytes, 16);
+
+        // valid UTF-8 goes to onText straight from the mapping; a sequence
+        // cut at the end of a chunk simply starts the next one.  Pure ASCII
+        // reads the same in UTF-8 and ANSI, so the encoding is decided by
+        // the first chunk with a non-ASCII byte, like loadTextFileW does
+        // for the whole file (a 1251 book may open with megabytes of ASCII)
+        enum class Encoding { Unknown, Utf8, Ansi } encoding = Encoding::Unknown;
+        std::wstring wide;                        // re-encoded chunk, reused
+        std::string utf8;
+        for (size_t pos = 0; pos < bytes.size();) {
+            const std::string_view block = bytes.substr(pos, chunkBytes);
+            const bool last = pos + block.size() == bytes.size();
+            const size_t got = block.size();
+
+            size_t take = got;
+            std::string_view text;
+            bool mapped = true;
+            if (encoding != Encoding::Ansi) {
+                if (!last) take = utf8CompletePrefix(block);
+                text = block.substr(0, take);
+                const size_t ascii = asciiPrefix(text);
+                if (ascii < text.size()) {                // all ASCII: still undecided
+                    if (utf8Valid(text.substr(ascii))) encoding = Encoding::Utf8;
+                    else if (encoding == Encoding::Utf8) {
+                        decodeUtf8(text, wide, false);    // invalid bytes -> U+FFFD
+                        utf8 = wideToUtf8(wide);
+                        text = utf8;
+                        mapped = false;
+                    }
+                    else encoding = Encoding::Ansi;       // first non-ASCII is not UTF-8
+                }
+            }
+            if (encoding == Encoding::Ansi) {
+                take = last ? got : ansiCompletePrefix(block);
+                decodeAnsi(block.substr(0, take), wide);
+                utf8 = wideToUtf8(wide);
+                text = utf8;
+                mapped = false;
+            }
+
+            if (!text.empty() && !onText(text, mapped)) return false;
+            pos += take;
+        }
+        return true;
+    }
+
 } // namespace manuscripta
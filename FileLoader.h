@@ -1,20 +1,49 @@
 ﻿#pragma once
 // FileLoader.h — tiny utility to read an entire text file into memory
 // Throws std::runtime_error on failure.
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
+#ifdef _WIN32
 #include <windows.h>
 
 std::wstring selectTxtFile(HWND owner = nullptr);
+#endif
 
 namespace manuscripta {
 
+	class MappedFile;
+
+	// Files are read through a read-only memory mapping (MappedFile): the
+	// bytes are decoded straight from the page cache, never copied first.
+
 	// Reads a text file (UTF‑8 or ANSI) into std::string.
 	// If you need wide char, use loadTextFileW below.
 	std::string loadTextFileA(const std::wstring& filePath);
 
 	// Reads a UTF‑16LE text file into std::wstring. If file is UTF‑8/ANSI it will
 	// be converted using MultiByteToWideChar with CP_UTF8 / CP_ACP fallback.
+	// Elsewhere (headless prewarm on Linux): UTF-8, falling back to Windows-1251.
 	std::wstring loadTextFileW(const std::wstring& filePath);
 
+	// Streaming variant for very large books: walks a mapped file about
+	// chunkBytes at a time and hands each chunk to onText as UTF-8 right away
+	// (the reader keeps the book in UTF-8, see TextStore.h). A UTF-8 file is
+	// only validated: such chunks come with mapped == true and are views of
+	// the file itself, valid as long as the mapping. Anything re-encoded (an
+	// ANSI book, U+FFFD for broken UTF-8) comes with mapped == false in a
+	// buffer that is reused by the next chunk.
+	// The encoding is decided on the first chunk with a non-ASCII byte (UTF-8
+	// if it is valid UTF-8, otherwise ANSI / Windows-1251); invalid UTF-8 later
+	// on becomes U+FFFD. Chunks never split a character.
+	// onText returns false to stop; the function then returns false.
+	bool streamTextFileUtf8(const MappedFile& file,
+		const std::function<bool(std::string_view text, bool mapped)>& onText, size_t chunkBytes = 1 << 20);
+
+	// Decodes a slice of a book's bytes the way the loaders do: strict UTF-8
+	// when utf8 is true (false = invalid), otherwise the ANSI code page
+	// (Windows-1251 elsewhere). Slices must not split a character.
+	bool decodeBookBytes(std::string_view bytes, bool utf8, std::wstring& out);
+
 } // namespace manuscripta
@@ -0,0 +1,40 @@
+﻿// GlyphCache.cpp — ленивый кэш ширин символов
+#include "GlyphCache.h"
+
+namespace manuscripta {
+
+    void GlyphAdvanceCache::Reset(uintptr_t fontKey, unsigned dpi, int lineHeight, Provider provider)
+    {
+        _low.assign(DIRECT, -1);
+        _high.clear();
+        _provider = std::move(provider);
+        _fontKey = fontKey;
+        _dpi = dpi;
+        _lineHeight = lineHeight;
+        _known = 0;
+        _misses = 0;
+    }
+
+    int GlyphAdvanceCache::Advance(char32_t cp)
+    {
+        if (cp < DIRECT && !_low.empty())
+        {
+            int& w = _low[cp];
+            if (w < 0) {
+                w = _provider ? _provider(cp) : 0;
+                ++_known;
+                ++_misses;
+            }
+            return w;
+        }
+
+        auto it = _high.find(cp);
+        if (it != _high.end()) return it->second;
+
+        ++_misses;
+        int w = _provider ? _provider(cp) : 0;
+        _high.emplace(cp, w);
+        return w;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,47 @@
+﻿#pragma once
+// GlyphCache.h — кэш ширин символов (advance width) для шрифта читалки.
+// Ключ — (шрифт, DPI); значения заполняются лениво через provider,
+// так что перенос строк (TextLayout) работает без HDC: к GDI идём
+// только за символом, который встретился впервые.
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace manuscripta {
+
+    class GlyphAdvanceCache
+    {
+    public:
+        // Ширина одного code point в пикселях (вызывается при промахе)
+        using Provider = std::function<int(char32_t)>;
+
+        // Сбросить кэш под новый шрифт / DPI
+        void Reset(uintptr_t fontKey, unsigned dpi, int lineHeight, Provider provider);
+        bool Matches(uintptr_t fontKey, unsigned dpi) const
+        {
+            return _provider && _fontKey == fontKey && _dpi == dpi;
+        }
+
+        int Advance(char32_t cp);
+
+        int    LineHeight() const { return _lineHeight; }
+        size_t Size() const { return _known + _high.size(); }
+        size_t Misses() const { return _misses; }
+
+    private:
+        // 0..0x7FF — латиница, кириллица, пунктуация: прямой массив
+        static constexpr char32_t DIRECT = 0x800;
+
+        std::vector<int>                  _low;      // -1 → ещё не спрашивали
+        std::unordered_map<char32_t, int> _high;
+        Provider  _provider;
+        uintptr_t _fontKey = 0;
+        unsigned  _dpi = 0;
+        int       _lineHeight = 0;
+        size_t    _known = 0;
+        size_t    _misses = 0;
+    };
+
+} // namespace manuscripta
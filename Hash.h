@@ -0,0 +1,36 @@
+﻿#pragma once
+// Hash.h — 64-битный FNV-1a для ключей дискового кэша (URL, текст кадра).
+// Не криптографический: нужен только стабильный между запусками ключ.
+// Текст хешируется в UTF-8 (wideToUtf8) — ключи одни на Windows и Linux
+// и совпадают с отпечатками кадров, которые читалка берёт прямо из книги.
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace manuscripta {
+
+    inline uint64_t hash64(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        uint64_t h = seed;
+        for (size_t i = 0; i < size; ++i) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    inline uint64_t hash64(std::string_view s) { return hash64(s.data(), s.size()); }
+
+    // 16 шестнадцатеричных цифр — годится в имя файла
+    inline std::string hashHex(uint64_t h)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string s(16, '0');
+        for (int i = 15; i >= 0; --i, h >>= 4)
+            s[i] = digits[h & 0xF];
+        return s;
+    }
+
+} // namespace manuscripta
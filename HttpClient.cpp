@@ -0,0 +1,293 @@
+﻿// HttpClient.cpp — одна сессия WinHTTP, пул соединений по хостам, метрики.
+// Общая часть (метрики, разбор URL) собирается везде; транспорт вне
+// Windows — HttpClientPosix.cpp.
+#include "HttpClient.h"
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#pragma comment(lib, "winhttp.lib")
+#endif
+
+namespace manuscripta {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        uint64_t usBetween(Clock::time_point a, Clock::time_point b)
+        {
+            if (a == Clock::time_point{} || b < a) return 0;
+            return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(b - a).count());
+        }
+    }
+
+    HttpClient& HttpClient::Shared()
+    {
+        static HttpClient client;
+        return client;
+    }
+
+    bool HttpClient::Get(const std::wstring& url, HttpResponse& out, const CancelToken& cancel)
+    {
+        out = {};
+        static const std::wstring scheme = L"http://";
+        if (url.compare(0, scheme.size(), scheme) != 0) return false;
+
+        size_t pathBegin = url.find(L'/', scheme.size());
+        if (pathBegin == std::wstring::npos) pathBegin = url.size();
+        std::wstring host = url.substr(scheme.size(), pathBegin - scheme.size());
+
+        uint16_t port = 80;
+        const size_t colon = host.rfind(L':');
+        if (colon != std::wstring::npos && host.find(L']', colon) == std::wstring::npos)
+        {
+            unsigned long n = 0;
+            for (size_t i = colon + 1; i < host.size(); ++i) {
+                if (host[i] < L'0' || host[i] > L'9') return false;
+                n = n * 10 + unsigned(host[i] - L'0');
+                if (n > 65535) return false;
+            }
+            if (n == 0) return false;
+            port = uint16_t(n);
+            host.resize(colon);
+        }
+        if (host.empty()) return false;
+
+        std::wstring path = pathBegin < url.size() ? url.substr(pathBegin) : L"/";
+        const size_t fragment = path.find(L'#');
+        if (fragment != std::wstring::npos) path.resize(fragment);
+
+        return Send(L"GET", host, port, path, L"", std::string(), out, cancel);
+    }
+
+#ifdef _WIN32
+    HttpClient::HttpClient(const wchar_t* userAgent, unsigned maxConnsPerHost)
+        : _maxPerHost(std::max(1u, maxConnsPerHost))
+    {
+        _session = WinHttpOpen(userAgent, WINHTTP_ACCESS_TYPE_NO_PROXY,
+            WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+        if (!_session) return;
+
+        DWORD conns = _maxPerHost;
+        WinHttpSetOption(_session, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &conns, sizeof(conns));
+        WinHttpSetOption(_session, WINHTTP_OPTION_MAX_CONNS_PER_1_0_SERVER, &conns, sizeof(conns));
+
+        // новые соединения видны по CONNECTING_TO_SERVER
+        WinHttpSetStatusCallback(_session, &HttpClient::statusCallback,
+            WINHTTP_CALLBACK_FLAG_RESOLVE_NAME | WINHTTP_CALLBACK_FLAG_CONNECT_TO_SERVER, 0);
+    }
+
+    HttpClient::~HttpClient()
+    {
+        for (auto& kv : _hosts)
+            if (kv.second.connect) WinHttpCloseHandle(kv.second.connect);
+        if (_session) {
+            WinHttpSetStatusCallback(_session, nullptr, 0, 0);
+            WinHttpCloseHandle(_session);
+        }
+    }
+
+    // Заполняет Trace из контекста запроса (в синхронном режиме — в том
+    // же потоке, внутри WinHttpSendRequest)
+    void CALLBACK HttpClient::statusCallback(HINTERNET, DWORD_PTR context,
+        DWORD status, LPVOID, DWORD)
+    {
+        Trace* t = reinterpret_cast<Trace*>(context);
+        if (!t) return;
+        const Clock::time_point now = Clock::now();
+        switch (status)
+        {
+        case WINHTTP_CALLBACK_STATUS_RESOLVING_NAME:       t->resolving = now; break;
+        case WINHTTP_CALLBACK_STATUS_NAME_RESOLVED:        t->resolved = now; break;
+        case WINHTTP_CALLBACK_STATUS_CONNECTING_TO_SERVER: t->connecting = now; break;
+        case WINHTTP_CALLBACK_STATUS_CONNECTED_TO_SERVER:  t->connected = now; break;
+        }
+    }
+
+    // Место в пуле хоста; ждём, если все соединения заняты
+    HINTERNET HttpClient::acquire(const HostKey& key)
+    {
+        std::unique_lock<std::mutex> lock(_hostsMutex);
+        Host& h = _hosts[key];
+        _hostsCv.wait(lock, [&] { return h.inFlight < _maxPerHost; });
+
+        if (!h.connect) {
+            h.connect = WinHttpConnect(_session, key.first.c_str(), key.second, 0);
+            if (!h.connect) return nullptr;
+        }
+        ++h.inFlight;
+        return h.connect;
+    }
+
+    bool HttpClient::Send(const wchar_t* method, const std::wstring& host, uint16_t port,
+        const std::wstring& path, const std::wstring& headers,
+        const std::string& body, HttpResponse& out, const CancelToken& cancel)
+    {
+        out = {};
+        if (!_session || cancel.IsCancelled()) return false;
+
+        const HostKey key{ host, port };
+        HINTERNET hConnect = acquire(key);
+        if (!hConnect) return false;
+
+        bool timeoutsSet;
+        HttpTimeouts timeouts;
+        {
+            std::lock_guard<std::mutex> lock(_hostsMutex);
+            timeoutsSet = _timeoutsSet;
+            timeouts = _timeouts;
+        }
+
+        Trace t;
+        bool answered = false;
+        HINTERNET hRequest = WinHttpOpenRequest(hConnect, method, path.c_str(),
+            nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, 0);
+
+        // закрытый из другого потока хэндл обрывает синхронные вызовы
+        // (ERROR_WINHTTP_OPERATION_CANCELLED); закрыть его должен ровно один.
+        // Закрытый хэндл больше не трогаем: перед каждым вызовом WinHTTP —
+        // alive() под тем же замком
+        std::mutex closeMutex;
+        bool open = hRequest != nullptr;
+        auto closeRequest = [&] {
+            std::lock_guard<std::mutex> lock(closeMutex);
+            if (open) { WinHttpCloseHandle(hRequest); open = false; }
+            };
+        auto alive = [&] {
+            std::lock_guard<std::mutex> lock(closeMutex);
+            if (!open) SetLastError(ERROR_WINHTTP_OPERATION_CANCELLED);
+            return open;
+            };
+
+        if (hRequest)
+        {
+            if (timeoutsSet)
+                WinHttpSetTimeouts(hRequest, int(timeouts.resolveMs), int(timeouts.connectMs),
+                    int(timeouts.sendMs), int(timeouts.receiveMs));
+
+            CancelScope abort(cancel, closeRequest);
+            t.sendBegin = Clock::now();
+            BOOL ok = alive() && WinHttpSendRequest(hRequest,
+                headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : headers.c_str(), (DWORD)-1,
+                (LPVOID)body.data(), (DWORD)body.size(), (DWORD)body.size(),
+                reinterpret_cast<DWORD_PTR>(&t));
+            t.sendEnd = Clock::now();
+
+            if (ok && alive() && WinHttpReceiveResponse(hRequest, nullptr))
+            {
+                t.headers = Clock::now();
+
+                DWORD code = 0, len = sizeof(code);
+                if (alive()) WinHttpQueryHeaders(hRequest,
+                    WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                    WINHTTP_HEADER_NAME_BY_INDEX, &code, &len, WINHTTP_NO_HEADER_INDEX);
+
+                // тело дочитываем до конца — иначе соединение не вернётся в пул;
+                // оборванное тело — не ответ
+                bool complete = true;
+                for (;;)
+                {
+                    DWORD avail = 0;
+                    if (!alive() || !WinHttpQueryDataAvailable(hRequest, &avail)) { complete = false; break; }
+                    if (!avail) break;
+                    const size_t at = out.body.size();
+                    out.body.resize(at + avail);
+                    DWORD n = 0;
+                    if (!alive() || !WinHttpReadData(hRequest, out.body.data() + at, avail, &n)) {
+                        out.body.resize(at);
+                        complete = false;
+                        break;
+                    }
+                    out.body.resize(at + n);
+                }
+                t.bodyEnd = Clock::now();
+                out.status = code;
+                answered = complete && code != 0;
+            }
+            if (!answered) {
+                t.timedOut = GetLastError() == ERROR_WINHTTP_TIMEOUT;
+                out = {};
+            }
+        }
+        closeRequest();
+        release(key);
+
+        // оборванный ответ — не ответ
+        const bool cancelled = cancel.IsCancelled();
+        if (cancelled) {
+            answered = false;
+            out = {};
+        }
+        record(t, answered, cancelled);
+        return answered;
+    }
+#endif // _WIN32
+
+    void HttpClient::SetMaxConnsPerHost(unsigned n)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_hostsMutex);
+            _maxPerHost = std::max(1u, n);
+#ifdef _WIN32
+            if (_session) {
+                DWORD conns = _maxPerHost;
+                WinHttpSetOption(_session, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &conns, sizeof(conns));
+                WinHttpSetOption(_session, WINHTTP_OPTION_MAX_CONNS_PER_1_0_SERVER, &conns, sizeof(conns));
+            }
+#endif
+        }
+        _hostsCv.notify_all();
+    }
+
+    void HttpClient::SetTimeouts(const HttpTimeouts& timeouts)
+    {
+        std::lock_guard<std::mutex> lock(_hostsMutex);
+        _timeouts = timeouts;
+        _timeoutsSet = true;
+#ifdef _WIN32
+        if (_session)
+            WinHttpSetTimeouts(_session, int(timeouts.resolveMs), int(timeouts.connectMs),
+                int(timeouts.sendMs), int(timeouts.receiveMs));
+#endif
+    }
+
+    void HttpClient::release(const HostKey& key)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_hostsMutex);
+            --_hosts[key].inFlight;
+        }
+        _hostsCv.notify_all();
+    }
+
+    void HttpClient::record(const Trace& t, bool answered, bool cancelled)
+    {
+        const uint64_t dns = usBetween(t.resolving, t.resolved);
+        const uint64_t connect = usBetween(t.connecting, t.connected);
+        const uint64_t sendAll = usBetween(t.sendBegin, t.sendEnd);
+        const uint64_t send = sendAll > dns + connect ? sendAll - dns - connect : 0;
+
+        std::lock_guard<std::mutex> lock(_metricsMutex);
+        HttpMetrics& m = _metrics;
+        ++m.requests;
+        if (cancelled) ++m.cancelled;
+        else if (t.timedOut) ++m.timeouts;
+        if (!answered) { ++m.failures; return; }
+
+        if (t.connecting != Clock::time_point{}) ++m.newConnections;
+        else ++m.reusedConnections;
+        m.dnsUs += dns;
+        m.connectUs += connect;
+        m.sendUs += send;
+        m.waitUs += usBetween(t.sendEnd, t.headers);
+        m.readUs += usBetween(t.headers, t.bodyEnd);
+        m.maxTotalUs = std::max(m.maxTotalUs, usBetween(t.sendBegin, t.bodyEnd));
+    }
+
+    HttpMetrics HttpClient::Metrics() const
+    {
+        std::lock_guard<std::mutex> lock(_metricsMutex);
+        return _metrics;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,167 @@
+﻿#pragma once
+// HttpClient.h — долгоживущий HTTP-клиент для запросов сцен.
+// Одна сессия WinHTTP на всё приложение: TCP-соединения с keep-alive
+// WinHTTP держит в пуле сессии, и следующий запрос к тому же хосту
+// не платит за DNS и установку соединения.  Сверху — ограничение
+// одновременных запросов на хост (не больше, чем соединений в пуле)
+// и метрики: доля переиспользованных соединений и время по фазам.
+//
+// Вне Windows (пакетная подготовка сцен на Linux) тот же интерфейс
+// реализован на сокетах POSIX в HttpClientPosix.cpp: только http://,
+// keep-alive — свой пул простаивающих соединений на хост.
+#ifdef _WIN32
+#include <windows.h>
+#include <winhttp.h>
+#endif
+#include "CancelToken.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace manuscripta {
+
+    struct HttpResponse
+    {
+        uint32_t    status = 0;         // 0 — ответа нет (сеть, таймаут)
+        std::string body;
+
+        bool Ok() const { return status >= 200 && status < 300; }
+    };
+
+    // Суммы по фазам — в микросекундах; средние считает вызывающий
+    struct HttpMetrics
+    {
+        uint64_t requests = 0;
+        uint64_t failures = 0;          // нет ответа (status == 0)
+        uint64_t cancelled = 0;         // прерваны токеном (входят в failures)
+        uint64_t timeouts = 0;          // истёк предел фазы (входят в failures)
+        uint64_t newConnections = 0;    // запрос открыл новое TCP-соединение
+        uint64_t reusedConnections = 0;
+        uint64_t dnsUs = 0;             // разрешение имени
+        uint64_t connectUs = 0;         // TCP connect
+        uint64_t sendUs = 0;            // отправка запроса (без DNS/connect)
+        uint64_t waitUs = 0;            // до заголовков ответа
+        uint64_t readUs = 0;            // тело ответа
+        uint64_t maxTotalUs = 0;
+
+        double ReuseRate() const
+        {
+            const uint64_t n = newConnections + reusedConnections;
+            return n ? double(reusedConnections) / double(n) : 0.0;
+        }
+    };
+
+    // Пределы по фазам, мс; 0 — без предела
+    struct HttpTimeouts
+    {
+        unsigned resolveMs = 0;         // только WinHTTP: getaddrinfo не прерывается
+        unsigned connectMs = 0;
+        unsigned sendMs = 0;
+        unsigned receiveMs = 0;         // ожидание заголовков и каждой порции тела
+    };
+
+    class HttpClient
+    {
+    public:
+        explicit HttpClient(const wchar_t* userAgent = L"Manuscripta/1.0",
+            unsigned maxConnsPerHost = 4);
+        ~HttpClient();
+        HttpClient(const HttpClient&) = delete;
+        HttpClient& operator=(const HttpClient&) = delete;
+
+        // Синхронный запрос; ждёт свободного места в пуле хоста.
+        // false — запрос не дошёл до ответа (out.status == 0).
+        // Отмена cancel закрывает запрос из другого потока — прерывает
+        // и ожидание ответа, и чтение тела.
+        bool Send(const wchar_t* method, const std::wstring& host, uint16_t port,
+            const std::wstring& path, const std::wstring& headers,
+            const std::string& body, HttpResponse& out, const CancelToken& cancel = {});
+
+        bool Post(const std::wstring& host, uint16_t port, const std::wstring& path,
+            const std::string& body, HttpResponse& out, const CancelToken& cancel = {})
+        {
+            return Send(L"POST", host, port, path,
+                L"Content-Type: application/json", body, out, cancel);
+        }
+
+        // GET по полному адресу "http://host[:port]/path"; https и
+        // прочие схемы — false
+        bool Get(const std::wstring& url, HttpResponse& out, const CancelToken& cancel = {});
+
+        HttpMetrics Metrics() const;
+
+        // Новый предел одновременных запросов на хост (пакетная
+        // подготовка сцен поднимает его до своей concurrency)
+        void SetMaxConnsPerHost(unsigned n);
+
+        // Для запросов, начатых после вызова.  До первого вызова — умолчания
+        // WinHTTP (60 с connect, 30 с send/receive), на POSIX — без пределов.
+        void SetTimeouts(const HttpTimeouts& timeouts);
+
+        // Общий клиент для SceneFetcher
+        static HttpClient& Shared();
+
+    private:
+        using HostKey = std::pair<std::wstring, uint16_t>;
+
+        // Времена фаз одного запроса; пустая отметка — фазы не было
+        struct Trace
+        {
+            using Clock = std::chrono::steady_clock;
+            Clock::time_point resolving, resolved;
+            Clock::time_point connecting, connected;
+            Clock::time_point sendBegin, sendEnd;
+            Clock::time_point headers, bodyEnd;
+            bool timedOut = false;
+        };
+
+#ifdef _WIN32
+        struct Host
+        {
+            HINTERNET connect = nullptr;  // лёгкий объект, соединения — в сессии
+            unsigned  inFlight = 0;
+        };
+
+        static void CALLBACK statusCallback(HINTERNET, DWORD_PTR context,
+            DWORD status, LPVOID, DWORD);
+
+        HINTERNET acquire(const HostKey& key);
+
+        HINTERNET _session = nullptr;
+#else
+        struct Host
+        {
+            std::vector<int> idle;         // открытые keep-alive сокеты
+            unsigned         inFlight = 0;
+        };
+
+        // Сокет из пула хоста (или -1 — открыть новый); ждёт места
+        int  acquire(const HostKey& key);
+        void release(const HostKey& key, int idleSocket);
+        // stale — соединение закрыто сервером до первого байта ответа
+        bool exchange(int fd, const std::string& request, HttpResponse& out,
+            bool& keepAlive, bool& stale, Trace& t);
+
+        std::string _userAgent;
+#endif
+        void release(const HostKey& key);
+        void record(const Trace& t, bool answered, bool cancelled);
+
+        unsigned  _maxPerHost;
+        HttpTimeouts _timeouts;            // под _hostsMutex
+        bool         _timeoutsSet = false;
+
+        std::mutex              _hostsMutex;
+        std::condition_variable _hostsCv;
+        std::map<HostKey, Host> _hosts;
+
+        mutable std::mutex _metricsMutex;
+        HttpMetrics        _metrics;
+    };
+
+} // namespace manuscripta
@@ -0,0 +1,401 @@
+﻿// HttpClientPosix.cpp — транспорт HttpClient на сокетах POSIX (Linux).
+// HTTP/1.1 с keep-alive: после полностью прочитанного ответа сокет
+// возвращается в пул хоста и следующий запрос идёт по нему же.
+// Только http:// — для пакетной подготовки сцен и локального сервера.
+#ifndef _WIN32
+#include "HttpClient.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace manuscripta {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr size_t MAX_LINE = 64 * 1024;           // строка статуса / заголовка
+        constexpr size_t MAX_BODY = size_t(256) << 20;   // больше не ждём
+
+        std::string lower(std::string s)
+        {
+            for (char& c : s)
+                if (c >= 'A' && c <= 'Z') c = char(c - 'A' + 'a');
+            return s;
+        }
+
+        std::string trim(const std::string& s)
+        {
+            size_t b = 0, e = s.size();
+            while (b < e && (s[b] == ' ' || s[b] == '\t')) ++b;
+            while (e > b && (s[e - 1] == ' ' || s[e - 1] == '\t')) --e;
+            return s.substr(b, e - b);
+        }
+
+        bool sendAll(int fd, const std::string& data)
+        {
+            size_t at = 0;
+            while (at < data.size())
+            {
+                const ssize_t n = ::send(fd, data.data() + at, data.size() - at, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                at += size_t(n);
+            }
+            return true;
+        }
+
+        // Буферизованное чтение ответа: строки до \r\n и блоки по длине
+        class SocketReader
+        {
+        public:
+            explicit SocketReader(int fd) : _fd(fd) {}
+
+            bool Line(std::string& line)
+            {
+                for (;;)
+                {
+                    const size_t eol = _buf.find("\r\n", _pos);
+                    if (eol != std::string::npos) {
+                        line.assign(_buf, _pos, eol - _pos);
+                        _pos = eol + 2;
+                        return true;
+                    }
+                    if (_buf.size() - _pos > MAX_LINE || !fill()) return false;
+                }
+            }
+
+            bool Bytes(size_t n, std::string& out)
+            {
+                while (_buf.size() - _pos < n)
+                    if (!fill()) return false;
+                out.append(_buf, _pos, n);
+                _pos += n;
+                return true;
+            }
+
+            // До закрытия соединения сервером
+            bool Rest(std::string& out)
+            {
+                do {
+                    out.append(_buf, _pos, std::string::npos);
+                    _pos = _buf.size();
+                    if (out.size() > MAX_BODY) return false;
+                } while (fill());
+                return _error == 0;
+            }
+
+            bool Received() const { return _received; }
+            // recv упёрся в SO_RCVTIMEO
+            bool TimedOut() const { return _error == EAGAIN || _error == EWOULDBLOCK; }
+
+        private:
+            bool fill()
+            {
+                if (_pos > 0 && _pos * 2 >= _buf.size()) {
+                    _buf.erase(0, _pos);
+                    _pos = 0;
+                }
+                char chunk[64 * 1024];
+                for (;;)
+                {
+                    const ssize_t n = ::recv(_fd, chunk, sizeof(chunk), 0);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n < 0) _error = errno;
+                    if (n <= 0) return false;
+                    _buf.append(chunk, size_t(n));
+                    _received = true;
+                    return true;
+                }
+            }
+
+            int         _fd;
+            int         _error = 0;
+            std::string _buf;
+            size_t      _pos = 0;
+            bool        _received = false;
+        };
+
+        // connect не дольше ms (0 — сколько даст система)
+        bool connectWithin(int fd, const sockaddr* addr, socklen_t len, unsigned ms, bool& timedOut)
+        {
+            if (ms == 0) return ::connect(fd, addr, len) == 0;
+
+            const int flags = ::fcntl(fd, F_GETFL, 0);
+            ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+            int rc = ::connect(fd, addr, len);
+            if (rc != 0 && errno == EINPROGRESS)
+            {
+                pollfd p{ fd, POLLOUT, 0 };
+                rc = ::poll(&p, 1, int(ms));
+                if (rc > 0) {
+                    int err = 0;
+                    socklen_t errLen = sizeof(err);
+                    ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+                    rc = err ? -1 : 0;
+                }
+                else {
+                    timedOut = timedOut || rc == 0;
+                    rc = -1;
+                }
+            }
+            ::fcntl(fd, F_SETFL, flags);
+            return rc == 0;
+        }
+
+        void setIoTimeouts(int fd, const HttpTimeouts& to)
+        {
+            timeval snd{ time_t(to.sendMs / 1000), suseconds_t((to.sendMs % 1000) * 1000) };
+            timeval rcv{ time_t(to.receiveMs / 1000), suseconds_t((to.receiveMs % 1000) * 1000) };
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &snd, sizeof(snd));
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rcv, sizeof(rcv));
+        }
+
+        // Разрешение имени и connect; отметки фаз — в t
+        template <class Trace>
+        int connectTo(const std::string& host, uint16_t port, unsigned connectMs, Trace& t)
+        {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* list = nullptr;
+
+            t.resolving = Clock::now();
+            const int rc = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &list);
+            t.resolved = Clock::now();
+            if (rc != 0 || !list) return -1;
+
+            int fd = -1;
+            t.connecting = Clock::now();
+            for (addrinfo* ai = list; ai && fd < 0; ai = ai->ai_next)
+            {
+                fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+                if (fd < 0) continue;
+                if (!connectWithin(fd, ai->ai_addr, ai->ai_addrlen, connectMs, t.timedOut)) {
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+            t.connected = Clock::now();
+            ::freeaddrinfo(list);
+
+            if (fd >= 0) {
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                t.timedOut = false;         // какой-то из адресов ответил
+            }
+            return fd;
+        }
+    }
+
+    HttpClient::HttpClient(const wchar_t* userAgent, unsigned maxConnsPerHost)
+        : _userAgent(wideToUtf8(userAgent ? userAgent : L""))
+        , _maxPerHost(std::max(1u, maxConnsPerHost))
+    {
+    }
+
+    HttpClient::~HttpClient()
+    {
+        for (auto& kv : _hosts)
+            for (int fd : kv.second.idle) ::close(fd);
+    }
+
+    int HttpClient::acquire(const HostKey& key)
+    {
+        std::unique_lock<std::mutex> lock(_hostsMutex);
+        Host& h = _hosts[key];
+        _hostsCv.wait(lock, [&] { return h.inFlight < _maxPerHost; });
+        ++h.inFlight;
+
+        if (h.idle.empty()) return -1;
+        const int fd = h.idle.back();
+        h.idle.pop_back();
+        return fd;
+    }
+
+    void HttpClient::release(const HostKey& key, int idleSocket)
+    {
+        if (idleSocket >= 0) {
+            std::lock_guard<std::mutex> lock(_hostsMutex);
+            _hosts[key].idle.push_back(idleSocket);
+        }
+        release(key);
+    }
+
+    bool HttpClient::exchange(int fd, const std::string& request, HttpResponse& out,
+        bool& keepAlive, bool& stale, Trace& t)
+    {
+        keepAlive = false;
+        stale = false;
+
+        t.sendBegin = Clock::now();
+        const bool sent = sendAll(fd, request);
+        const int sendError = sent ? 0 : errno;
+        t.sendEnd = Clock::now();
+
+        SocketReader in(fd);
+        auto fail = [&] {
+            t.timedOut = sendError == EAGAIN || sendError == EWOULDBLOCK || in.TimedOut();
+            return false;
+            };
+
+        std::string line;
+        if (!sent || !in.Line(line)) {
+            stale = !in.Received() && !in.TimedOut() && sendError != EAGAIN && sendError != EWOULDBLOCK;
+            return fail();
+        }
+
+        // "HTTP/1.1 200 OK"
+        if (line.compare(0, 5, "HTTP/") != 0) return fail();
+        const size_t sp = line.find(' ');
+        if (sp == std::string::npos) return fail();
+        const uint32_t code = uint32_t(std::strtoul(line.c_str() + sp + 1, nullptr, 10));
+        if (code < 100 || code > 999) return fail();
+        keepAlive = line.compare(0, 8, "HTTP/1.0") != 0;
+
+        long long length = -1;
+        bool chunked = false;
+        for (;;)
+        {
+            if (!in.Line(line)) return fail();
+            if (line.empty()) break;
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            const std::string name = lower(trim(line.substr(0, colon)));
+            const std::string value = lower(trim(line.substr(colon + 1)));
+            if (name == "content-length") length = std::strtoll(value.c_str(), nullptr, 10);
+            else if (name == "transfer-encoding") chunked = value.find("chunked") != std::string::npos;
+            else if (name == "connection") {
+                if (value.find("close") != std::string::npos) keepAlive = false;
+                else if (value.find("keep-alive") != std::string::npos) keepAlive = true;
+            }
+        }
+        t.headers = Clock::now();
+
+        if (code == 204 || code == 304 || (code >= 100 && code < 200)) {
+            // тела нет
+        }
+        else if (chunked)
+        {
+            for (;;)
+            {
+                if (!in.Line(line)) return fail();
+                const size_t n = size_t(std::strtoull(line.c_str(), nullptr, 16));
+                if (n == 0) break;
+                if (out.body.size() + n > MAX_BODY || !in.Bytes(n, out.body) || !in.Line(line))
+                    return fail();
+            }
+            while (in.Line(line) && !line.empty()) {}      // trailer
+        }
+        else if (length >= 0)
+        {
+            if (size_t(length) > MAX_BODY || !in.Bytes(size_t(length), out.body)) return fail();
+        }
+        else
+        {
+            keepAlive = false;                             // тело — до закрытия
+            if (!in.Rest(out.body)) return fail();
+        }
+        t.bodyEnd = Clock::now();
+        out.status = code;
+        return true;
+    }
+
+    bool HttpClient::Send(const wchar_t* method, const std::wstring& host, uint16_t port,
+        const std::wstring& path, const std::wstring& headers,
+        const std::string& body, HttpResponse& out, const CancelToken& cancel)
+    {
+        out = {};
+        if (cancel.IsCancelled()) return false;
+
+        const std::string host8 = wideToUtf8(host);
+        std::string request = wideToUtf8(method) + ' ' + wideToUtf8(path) + " HTTP/1.1\r\n";
+        request += "Host: " + host8;
+        if (port != 80) request += ':' + std::to_string(port);
+        request += "\r\nUser-Agent: " + _userAgent + "\r\nConnection: keep-alive\r\n";
+        if (!body.empty() || std::wcscmp(method, L"GET") != 0)
+            request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        if (!headers.empty())
+            request += wideToUtf8(headers) + "\r\n";
+        request += "\r\n";
+        request += body;
+
+        HttpTimeouts timeouts;
+        {
+            std::lock_guard<std::mutex> lock(_hostsMutex);
+            timeouts = _timeouts;
+        }
+
+        const HostKey key{ host, port };
+        int fd = acquire(key);
+
+        // shutdown() из другого потока будит recv/send; разрешение имени
+        // и connect отмена не прерывает — connect ограничен connectMs,
+        // getaddrinfo — только системой
+        std::mutex activeMutex;
+        int active = -1;
+        auto setActive = [&](int s) {
+            std::lock_guard<std::mutex> lock(activeMutex);
+            active = s;
+            };
+
+        Trace t;
+        bool answered = false, keepAlive = false;
+        {
+            CancelScope abort(cancel, [&] {
+                std::lock_guard<std::mutex> lock(activeMutex);
+                if (active >= 0) ::shutdown(active, SHUT_RDWR);
+                });
+
+            // сервер мог закрыть простаивавшее соединение — тогда ровно
+            // один повтор по новому
+            for (int attempt = 0; attempt < 2 && !cancel.IsCancelled(); ++attempt)
+            {
+                const bool reused = fd >= 0;
+                if (!reused) fd = connectTo(host8, port, timeouts.connectMs, t);
+                if (fd < 0) break;
+                setIoTimeouts(fd, timeouts);
+
+                setActive(fd);
+                bool stale = false;
+                answered = !cancel.IsCancelled()
+                    && exchange(fd, request, out, keepAlive, stale, t);
+                setActive(-1);
+                if (answered) break;
+
+                ::close(fd);
+                fd = -1;
+                out = {};
+                if (!reused || !stale) break;
+                t = Trace{};
+            }
+        }
+
+        if (fd >= 0 && !(answered && keepAlive)) {
+            ::close(fd);
+            fd = -1;
+        }
+        release(key, fd);
+
+        // оборванный ответ — не ответ
+        const bool cancelled = cancel.IsCancelled();
+        if (cancelled) {
+            answered = false;
+            out = {};
+        }
+        record(t, answered, cancelled);
+        return answered;
+    }
+
+} // namespace manuscripta
+#endif // !_WIN32
@@ -2,9 +2,14 @@
 // ImageCache.cpp
 ///////////////////////////////////////
 #include "ImageCache.h"
+#include "DiskCache.h"
+#include "Hash.h"
+#include "Utf8.h"
 #include <urlmon.h>
 #include <gdiplus.h>
 #include <shlwapi.h>
+#include <functional>
+#include <vector>
 
 #pragma comment(lib, "urlmon.lib")
 #pragma comment(lib, "gdiplus.lib")
@@ -12,11 +17,14 @@
 
 using namespace Gdiplus;
 
+std::mutex ImageCache::_gdiplusMutex;
 bool       ImageCache::_gdiplusStarted = false;
 ULONG_PTR  ImageCache::_gdiplusToken = 0;
+int        ImageCache::_instances = 0;
 
 void ImageCache::ensureGdiplus()
 {
+    std::lock_guard<std::mutex> lock(_gdiplusMutex);
     if (!_gdiplusStarted)
     {
         GdiplusStartupInput gdiSI;
@@ -25,55 +33,366 @@ void ImageCache::ensureGdiplus()
     }
 }
 
-HBITMAP ImageCache::Get(const std::wstring& url)
+ImageCache::ImageCache(size_t budgetBytes)
+    : _budget(budgetBytes)
 {
-    auto it = _cache.find(url);
-    if (it != _cache.end()) return it->second;
+    std::lock_guard<std::mutex> lock(_gdiplusMutex);
+    ++_instances;
+}
+
+ImageCache::Shard& ImageCache::shardFor(const std::wstring& url)
+{
+    return _shards[std::hash<std::wstring>{}(url) % SHARDS];
+}
+
+const ImageCache::Shard& ImageCache::shardFor(const std::wstring& url) const
+{
+    return _shards[std::hash<std::wstring>{}(url) % SHARDS];
+}
+
+HBITMAP ImageCache::Get(const std::wstring& url, const manuscripta::CancelToken& cancel)
+{
+    Shard& shard = shardFor(url);
+
+    for (;;)
+    {
+        // 1. hit, or join an in-flight download, or become its owner
+        std::promise<HBITMAP> promise;
+        std::shared_future<HBITMAP> pending;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(url);
+            if (it != shard.entries.end()) {
+                pending = it->second;
+            }
+            else {
+                pending = promise.get_future().share();
+                shard.entries.emplace(url, pending);
+                owner = true;
+            }
+        }
+        if (!owner)
+        {
+            HBITMAP bmp = nullptr;
+            try { bmp = pending.get(); }        // waits outside the shard lock
+            catch (const Cancelled&) {          // not our cancellation: retry
+                if (cancel.IsCancelled()) return nullptr;
+                continue;
+            }
+            if (!bmp) return nullptr;           // the owner's download failed
+            if (acquire(url, bmp)) {
+                ++_hits;
+                return bmp;
+            }
+            // evicted between the lookup and the lease (the handle may
+            // even belong to another URL by now): drop the stale entry
+            // (unless evictToBudget already did) and load again
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(url);
+            if (it != shard.entries.end() &&
+                it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+                it->second.get() == bmp)
+                shard.entries.erase(it);
+            continue;
+        }
 
-    std::wstring tmpFile = downloadToTemp(url);
-    if (tmpFile.empty()) return nullptr;
+        ++_misses;
+
+        // 2. download + decode without holding any lock
+        HBITMAP bmp = nullptr;
+        try { bmp = fetch(url, cancel); }
+        catch (...) { bmp = nullptr; }
+
+        // 3. failures are dropped so a later Get() can retry
+        if (!bmp)
+        {
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.entries.erase(url);
+            }
+            if (cancel.IsCancelled()) {
+                promise.set_exception(std::make_exception_ptr(Cancelled{}));
+                return nullptr;
+            }
+        }
+        else
+        {
+            admit(url, bmp);                    // before waiters can see it
+        }
+        promise.set_value(bmp);
+        if (bmp) evictToBudget();
+        return bmp;
+    }
+}
+
+HBITMAP ImageCache::Peek(const std::wstring& url) const
+{
+    const Shard& shard = shardFor(url);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(url);
+    if (it == shard.entries.end()) return nullptr;
+    if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return nullptr;
+    return it->second.get();
+}
+
+size_t ImageCache::pixelBytes(HBITMAP bmp)
+{
+    BITMAP bm{};
+    if (!GetObject(bmp, sizeof(bm), &bm)) return 0;
+    return size_t(bm.bmWidthBytes) * size_t(bm.bmHeight) * (bm.bmPlanes ? bm.bmPlanes : 1);
+}
+
+// New bitmap: owner's lease, front of the LRU
+void ImageCache::admit(const std::wstring& url, HBITMAP bmp)
+{
+    const size_t bytes = pixelBytes(bmp);
+    std::lock_guard<std::mutex> lock(_lruMutex);
+    _lru.push_front(bmp);
+    Resident& r = _resident[bmp];
+    r.url = url;
+    r.bytes = bytes;
+    r.leases = 1;
+    r.lru = _lru.begin();
+    _bytes += bytes;
+}
+
+// false: already evicted, the handle must not be used.  GDI recycles
+// handle values, so an evicted bitmap's handle may already name another
+// URL's admitted bitmap: the URL has to match as well
+bool ImageCache::acquire(const std::wstring& url, HBITMAP bmp)
+{
+    std::lock_guard<std::mutex> lock(_lruMutex);
+    auto it = _resident.find(bmp);
+    if (it == _resident.end() || it->second.url != url) return false;
+    ++it->second.leases;
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    return true;
+}
+
+// caller holds _lruMutex
+void ImageCache::unlease(HBITMAP bmp)
+{
+    auto it = _resident.find(bmp);
+    if (it != _resident.end() && it->second.leases > 0)
+        --it->second.leases;
+}
+
+void ImageCache::SetDisplayed(HBITMAP bmp)
+{
+    {
+        std::lock_guard<std::mutex> lock(_lruMutex);
+        if (bmp) {
+            unlease(bmp);
+            auto it = _resident.find(bmp);
+            if (it != _resident.end())
+                _lru.splice(_lru.begin(), _lru, it->second.lru);
+        }
+        _displayed = bmp;
+    }
+    evictToBudget();                            // the previous one may go now
+}
+
+void ImageCache::Release(HBITMAP bmp)
+{
+    if (!bmp) return;
+    {
+        std::lock_guard<std::mutex> lock(_lruMutex);
+        unlease(bmp);
+    }
+    evictToBudget();
+}
+
+void ImageCache::SetBudgetBytes(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(_lruMutex);
+        _budget = bytes;
+    }
+    evictToBudget();
+}
+
+ImageCacheStats ImageCache::Stats() const
+{
+    ImageCacheStats s;
+    s.hits = _hits.load();
+    s.misses = _misses.load();
+    std::lock_guard<std::mutex> lock(_lruMutex);
+    s.evictions = _evictions;
+    s.bytes = _bytes;
+    s.budget = _budget;
+    s.entries = _resident.size();
+    return s;
+}
+
+void ImageCache::evictToBudget()
+{
+    // 1. pick victims from the cold end; leased and displayed ones stay
+    std::vector<std::pair<std::wstring, HBITMAP>> victims;
+    {
+        std::lock_guard<std::mutex> lock(_lruMutex);
+        auto it = _lru.end();
+        while (_bytes > _budget && it != _lru.begin())
+        {
+            --it;
+            HBITMAP bmp = *it;
+            auto res = _resident.find(bmp);
+            if (bmp == _displayed || res->second.leases > 0)
+                continue;
+
+            _bytes -= res->second.bytes;
+            victims.emplace_back(std::move(res->second.url), bmp);
+            _resident.erase(res);
+            it = _lru.erase(it);
+            ++_evictions;
+        }
+    }
+
+    // 2. forget the URLs (shard locks, not nested in _lruMutex) and free
+    for (auto& [url, bmp] : victims)
+    {
+        Shard& shard = shardFor(url);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(url);
+            if (it != shard.entries.end() &&
+                it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+                it->second.get() == bmp)
+                shard.entries.erase(it);
+        }
+        DeleteObject(bmp);
+    }
+}
+
+HBITMAP ImageCache::fetch(const std::wstring& url, const manuscripta::CancelToken& cancel)
+{
+    const std::string key = "img-" + manuscripta::hashHex(manuscripta::hash64(manuscripta::wideToUtf8(url)));
+    std::string bytes;
+
+    // 1. encoded image from an earlier session
+    if (_disk && _disk->Read(key, bytes))
+    {
+        ensureGdiplus();
+        if (HBITMAP bmp = decodeBitmap(bytes))
+            return bmp;
+        _disk->Remove(key);                 // unreadable: download again
+    }
+
+    // 2. network, straight into memory
+    if (!downloadToMemory(url, bytes, cancel)) return nullptr;
 
     ensureGdiplus();
-    HBITMAP bmp = loadBitmapFromFile(tmpFile);
-    if (bmp) _cache[url] = bmp;
+    HBITMAP bmp = decodeBitmap(bytes);
+
+    // 3. only decodable images are kept; the write is not waited for
+    if (bmp && _disk)
+        _disk->WriteAsync(key, std::move(bytes));
     return bmp;
 }
 
-//HBITMAP ImageCache::Peek(const std::wstring& url) const
-//{
-//    auto it = _cache.find(url);
-//    return (it != _cache.end()) ? it->second : nullptr;
-//}
+namespace
+{
+    // Lets urlmon poll the token: E_ABORT from OnProgress stops the
+    // binding, including a blocking Read() on the stream.
+    class AbortOnCancel : public IBindStatusCallback
+    {
+    public:
+        explicit AbortOnCancel(const manuscripta::CancelToken& cancel) : _cancel(cancel) {}
+
+        // IUnknown; lives on the caller's stack
+        STDMETHODIMP QueryInterface(REFIID riid, void** ppv) override
+        {
+            if (riid == IID_IUnknown || riid == IID_IBindStatusCallback) {
+                *ppv = static_cast<IBindStatusCallback*>(this);
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+        STDMETHODIMP_(ULONG) AddRef() override { return 1; }
+        STDMETHODIMP_(ULONG) Release() override { return 1; }
+
+        STDMETHODIMP OnStartBinding(DWORD, IBinding*) override { return abortIfCancelled(); }
+        STDMETHODIMP GetPriority(LONG*) override { return E_NOTIMPL; }
+        STDMETHODIMP OnLowResource(DWORD) override { return S_OK; }
+        STDMETHODIMP OnProgress(ULONG, ULONG, ULONG, LPCWSTR) override { return abortIfCancelled(); }
+        STDMETHODIMP OnStopBinding(HRESULT, LPCWSTR) override { return S_OK; }
+        STDMETHODIMP GetBindInfo(DWORD*, BINDINFO*) override { return E_NOTIMPL; }
+        STDMETHODIMP OnDataAvailable(DWORD, DWORD, FORMATETC*, STGMEDIUM*) override { return abortIfCancelled(); }
+        STDMETHODIMP OnObjectAvailable(REFIID, IUnknown*) override { return S_OK; }
+
+    private:
+        HRESULT abortIfCancelled() const { return _cancel.IsCancelled() ? E_ABORT : S_OK; }
+        const manuscripta::CancelToken& _cancel;
+    };
+}
 
-std::wstring ImageCache::downloadToTemp(const std::wstring& url)
+bool ImageCache::downloadToMemory(const std::wstring& url, std::string& bytes,
+                                  const manuscripta::CancelToken& cancel)
 {
-    WCHAR tmpDir[MAX_PATH]{};
-    WCHAR tmpName[MAX_PATH]{};
-    GetTempPathW(MAX_PATH, tmpDir);
-    GetTempFileNameW(tmpDir, L"msc", 0, tmpName);
+    constexpr size_t MAX_IMAGE = 64u << 20;        // a runaway response is not an image
 
-    if (FAILED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED))) return L"";
-    HRESULT hr = URLDownloadToFileW(nullptr, url.c_str(), tmpName, 0, nullptr);
+    bytes.clear();
+    if (cancel.IsCancelled()) return false;
+    if (FAILED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED))) return false;
+
+    AbortOnCancel progress(cancel);
+    IStream* stream = nullptr;
+    HRESULT hr = URLOpenBlockingStreamW(nullptr, url.c_str(), &stream, 0, &progress);
+    if (SUCCEEDED(hr))
+    {
+        char buf[64 * 1024];
+        for (;;)
+        {
+            if (cancel.IsCancelled()) { hr = E_ABORT; break; }
+            ULONG n = 0;
+            hr = stream->Read(buf, sizeof(buf), &n);
+            if (FAILED(hr)) break;
+            bytes.append(buf, n);
+            if (hr == S_FALSE || n == 0) { hr = S_OK; break; }
+            if (bytes.size() > MAX_IMAGE) { hr = E_FAIL; break; }
+        }
+        stream->Release();
+    }
     CoUninitialize();
-    return SUCCEEDED(hr) ? std::wstring(tmpName) : L"";
+    return SUCCEEDED(hr) && !bytes.empty();
 }
 
-HBITMAP ImageCache::loadBitmapFromFile(const std::wstring& file)
+HBITMAP ImageCache::decodeBitmap(const std::string& bytes)
 {
-    Bitmap bmp(file.c_str());
-    if (bmp.GetLastStatus() != Ok)
-        return nullptr;
+    IStream* stream = SHCreateMemStream(
+        reinterpret_cast<const BYTE*>(bytes.data()), static_cast<UINT>(bytes.size()));
+    if (!stream) return nullptr;
 
     HBITMAP hBmp = nullptr;
-    bmp.GetHBITMAP(Color::Black, &hBmp);
+    {
+        // GDI+ reads the stream lazily: it must outlive the Bitmap
+        Bitmap bmp(stream);
+        if (bmp.GetLastStatus() == Ok)
+            bmp.GetHBITMAP(Color::Black, &hBmp);
+    }
+    stream->Release();
     return hBmp;
 }
 
 ImageCache::~ImageCache()
 {
-    for (auto& kv : _cache)
-        if (kv.second) DeleteObject(kv.second);
+    for (auto& shard : _shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& kv : shard.entries)
+        {
+            if (kv.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;                       // owner is still downloading
+            if (HBITMAP bmp = kv.second.get()) DeleteObject(bmp);
+        }
+    }
 
-    if (_gdiplusStarted)
+    std::lock_guard<std::mutex> lock(_gdiplusMutex);
+    if (--_instances == 0 && _gdiplusStarted)
+    {
         GdiplusShutdown(_gdiplusToken);
+        _gdiplusStarted = false;
+    }
 }
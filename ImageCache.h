@@ -4,24 +4,120 @@
 #pragma once
 #include <string>
 #include <map>
+#include <array>
+#include <list>
+#include <unordered_map>
+#include <atomic>
+#include <future>
+#include <mutex>
 #include <windows.h>
+#include "CancelToken.h"
+
+namespace manuscripta { class DiskCache; }
+
+// Thread-safe: Get() is called from the fetchSceneAsync worker threads.
+// The map is split into shards, each with its own mutex, and concurrent
+// requests for the same URL share one download/decode (single-flight).
+//
+// Memory is bounded by a byte budget over the decoded pixel size of each
+// bitmap.  Least-recently-used bitmaps are evicted (DeleteObject) once the
+// budget is exceeded, except those still in use:
+//   - every non-null Get() hands out a lease; the caller passes the bitmap
+//     on to SetDisplayed() or gives it back with Release();
+//   - the bitmap last passed to SetDisplayed() is on screen.
+//
+// Images are downloaded into memory and decoded from there.  With a
+// DiskCache attached, the encoded bytes are also kept under
+// "img-<hash of URL>" (written in the background, off the Get() path)
+// and later loads of the same URL skip the network.
+struct ImageCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t bytes = 0;               // decoded pixels currently held
+    size_t budget = 0;
+    size_t entries = 0;
+};
 
 class ImageCache
 {
 public:
+    static constexpr size_t DEFAULT_BUDGET = 128u << 20;
+
     //  HBITMAP  nullptr  .
-    HBITMAP Get(const std::wstring& url);
+    // cancel aborts this caller's download; others waiting on the same
+    // URL then load it themselves
+    HBITMAP Get(const std::wstring& url, const manuscripta::CancelToken& cancel = {});
+    // No lease: only for a quick look on the UI thread
     HBITMAP Peek(const std::wstring& url) const;
+
+    // Lease from Get() becomes the on-screen bitmap (nullptr: nothing shown)
+    void SetDisplayed(HBITMAP bmp);
+    // Lease from Get() is not going to be used
+    void Release(HBITMAP bmp);
+
+    void SetBudgetBytes(size_t bytes);
+    // Not owned; must outlive the cache.  nullptr: no disk cache
+    void AttachDiskCache(manuscripta::DiskCache* disk) { _disk = disk; }
+    ImageCacheStats Stats() const;
+
+    explicit ImageCache(size_t budgetBytes = DEFAULT_BUDGET);
     ~ImageCache();
+    ImageCache(const ImageCache&) = delete;
+    ImageCache& operator=(const ImageCache&) = delete;
 
 private:
-    std::map<std::wstring, HBITMAP> _cache;
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        // ready or in-flight result; failures are not kept
+        std::map<std::wstring, std::shared_future<HBITMAP>> entries;
+    };
+    static constexpr size_t SHARDS = 16;
+    std::array<Shard, SHARDS> _shards;
+
+    // Accounting for ready bitmaps, most recently used first.
+    // Lock order: a shard mutex may be held while taking _lruMutex,
+    // never the other way round.
+    struct Resident
+    {
+        std::wstring url;
+        size_t bytes = 0;
+        unsigned leases = 0;
+        std::list<HBITMAP>::iterator lru;
+    };
+    mutable std::mutex _lruMutex;
+    std::list<HBITMAP> _lru;
+    std::unordered_map<HBITMAP, Resident> _resident;
+    HBITMAP _displayed = nullptr;
+    size_t _bytes = 0;
+    size_t _budget = DEFAULT_BUDGET;
+    size_t _evictions = 0;
+    std::atomic<size_t> _hits{ 0 };
+    std::atomic<size_t> _misses{ 0 };
+
+    manuscripta::DiskCache* _disk = nullptr;
+
+    Shard& shardFor(const std::wstring& url);
+    const Shard& shardFor(const std::wstring& url) const;
+    HBITMAP      fetch(const std::wstring& url, const manuscripta::CancelToken& cancel);
+    struct Cancelled {};            // owner's download was aborted
+
+    void admit(const std::wstring& url, HBITMAP bmp);
+    bool acquire(const std::wstring& url, HBITMAP bmp);
+    void unlease(HBITMAP bmp);
+    void evictToBudget();
+    static size_t pixelBytes(HBITMAP bmp);
 
     // helpers
     static void ensureGdiplus();
+    static std::mutex _gdiplusMutex;
     static bool _gdiplusStarted;
+    static int _instances;          // GDI+ is shut down with the last cache
     static ULONG_PTR _gdiplusToken;
 
-    std::wstring downloadToTemp(const std::wstring& url);
-    HBITMAP      loadBitmapFromFile(const std::wstring& file);
+    static bool    downloadToMemory(const std::wstring& url, std::string& bytes,
+                                    const manuscripta::CancelToken& cancel);
+    static HBITMAP decodeBitmap(const std::string& bytes);
 };
\ No newline at end of file
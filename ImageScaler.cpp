@@ -0,0 +1,205 @@
+﻿// ImageScaler.cpp — раздельный Ланцош-3: горизонтальный проход в
+// промежуточный 8-битный буфер, затем вертикальный
+#include "ImageScaler.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MANUSCRIPTA_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace manuscripta {
+
+    namespace {
+
+        constexpr double PI = 3.14159265358979323846;
+
+        double lanczos3(double x)
+        {
+            x = std::fabs(x);
+            if (x < 1e-9) return 1.0;
+            if (x >= 3.0) return 0.0;
+            return 3.0 * std::sin(PI * x) * std::sin(PI * x / 3.0) / (PI * PI * x * x);
+        }
+
+        // Веса для одного измерения: выходной пиксель i берёт
+        // count[i] входных, начиная с first[i], с весами w[i * stride ...]
+        struct Taps
+        {
+            std::vector<int>   first;
+            std::vector<int>   count;
+            std::vector<float> w;
+            int                stride = 0;
+        };
+
+        Taps makeTaps(int srcLen, int dstLen)
+        {
+            const double scale = double(dstLen) / srcLen;
+            const double filterScale = scale < 1.0 ? 1.0 / scale : 1.0;   // при уменьшении — шире
+            const double support = 3.0 * filterScale;
+
+            Taps t;
+            t.stride = int(std::ceil(support)) * 2 + 1;
+            t.first.resize(dstLen);
+            t.count.resize(dstLen);
+            t.w.assign(size_t(dstLen) * t.stride, 0.0f);
+
+            std::vector<double> tmp(t.stride);
+            for (int i = 0; i < dstLen; ++i)
+            {
+                const double center = (i + 0.5) / scale;
+                int lo = std::max(0, int(std::floor(center - support)));
+                int hi = std::min(srcLen, int(std::ceil(center + support)));
+                hi = std::min(hi, lo + t.stride);
+
+                double sum = 0.0;
+                for (int j = lo; j < hi; ++j)
+                    sum += (tmp[j - lo] = lanczos3((j + 0.5 - center) / filterScale));
+                if (sum == 0.0) { tmp[0] = sum = 1.0; hi = lo + 1; }
+
+                t.first[i] = lo;
+                t.count[i] = hi - lo;
+                for (int j = lo; j < hi; ++j)
+                    t.w[size_t(i) * t.stride + (j - lo)] = float(tmp[j - lo] / sum);
+            }
+            return t;
+        }
+
+#ifdef MANUSCRIPTA_SSE2
+        inline __m128 unpackPx(uint32_t p)
+        {
+            const __m128i z = _mm_setzero_si128();
+            __m128i v = _mm_cvtsi32_si128(static_cast<int>(p));
+            v = _mm_unpacklo_epi8(v, z);
+            v = _mm_unpacklo_epi16(v, z);
+            return _mm_cvtepi32_ps(v);
+        }
+
+        inline uint32_t packPx(__m128 f)
+        {
+            __m128i i = _mm_cvtps_epi32(f);          // округление к ближайшему
+            i = _mm_packs_epi32(i, i);
+            i = _mm_packus_epi16(i, i);              // насыщение в [0, 255]
+            return static_cast<uint32_t>(_mm_cvtsi128_si32(i));
+        }
+#endif
+
+        // lrint — к ближайшему чётному, как _mm_cvtps_epi32: скаляр и
+        // SSE2 дают одни и те же байты
+        inline uint32_t packPx(const float* f)
+        {
+            uint32_t r = 0;
+            for (int c = 0; c < 4; ++c) {
+                long v = std::lrint(f[c]);
+                v = v < 0 ? 0 : (v > 255 ? 255 : v);
+                r |= uint32_t(v) << (8 * c);
+            }
+            return r;
+        }
+
+        template <bool Simd>
+        void horizontalPass(const ConstPixelBuffer& src, const Taps& t,
+            std::vector<uint32_t>& out, int dw)
+        {
+            out.resize(size_t(dw) * src.height);
+            for (int y = 0; y < src.height; ++y)
+            {
+                const uint32_t* row = src.pixels + size_t(y) * src.stride;
+                uint32_t* dst = out.data() + size_t(y) * dw;
+                for (int x = 0; x < dw; ++x)
+                {
+                    const float* w = t.w.data() + size_t(x) * t.stride;
+                    const uint32_t* p = row + t.first[x];
+#ifdef MANUSCRIPTA_SSE2
+                    if constexpr (Simd) {
+                        __m128 acc = _mm_setzero_ps();
+                        for (int k = 0; k < t.count[x]; ++k)
+                            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), unpackPx(p[k])));
+                        dst[x] = packPx(acc);
+                        continue;
+                    }
+#endif
+                    float acc[4] = {};
+                    for (int k = 0; k < t.count[x]; ++k)
+                        for (int c = 0; c < 4; ++c)
+                            acc[c] += w[k] * float((p[k] >> (8 * c)) & 0xFF);
+                    dst[x] = packPx(acc);
+                }
+            }
+        }
+
+        // Вертикаль: строка-аккумулятор, внешний цикл по весам —
+        // входные строки читаются последовательно
+        template <bool Simd>
+        void verticalPass(const std::vector<uint32_t>& tmp, int dw, const Taps& t,
+            const PixelBuffer& dst)
+        {
+            std::vector<float> acc(size_t(dw) * 4);
+            for (int y = 0; y < dst.height; ++y)
+            {
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                const float* w = t.w.data() + size_t(y) * t.stride;
+                for (int k = 0; k < t.count[y]; ++k)
+                {
+                    const uint32_t* row = tmp.data() + size_t(t.first[y] + k) * dw;
+#ifdef MANUSCRIPTA_SSE2
+                    if constexpr (Simd) {
+                        const __m128 wk = _mm_set1_ps(w[k]);
+                        for (int x = 0; x < dw; ++x)
+                        {
+                            float* a = acc.data() + size_t(x) * 4;
+                            _mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), _mm_mul_ps(wk, unpackPx(row[x]))));
+                        }
+                        continue;
+                    }
+#endif
+                    for (int x = 0; x < dw; ++x)
+                        for (int c = 0; c < 4; ++c)
+                            acc[size_t(x) * 4 + c] += w[k] * float((row[x] >> (8 * c)) & 0xFF);
+                }
+
+                uint32_t* out = dst.pixels + size_t(y) * dst.stride;
+                for (int x = 0; x < dw; ++x)
+                {
+#ifdef MANUSCRIPTA_SSE2
+                    if constexpr (Simd) {
+                        out[x] = packPx(_mm_loadu_ps(acc.data() + size_t(x) * 4));
+                        continue;
+                    }
+#endif
+                    out[x] = packPx(acc.data() + size_t(x) * 4);
+                }
+            }
+        }
+
+        template <bool Simd>
+        bool resample(const ConstPixelBuffer& src, const PixelBuffer& dst)
+        {
+            if (!src.pixels || !dst.pixels ||
+                src.width <= 0 || src.height <= 0 || dst.width <= 0 || dst.height <= 0)
+                return false;
+
+            const Taps hx = makeTaps(src.width, dst.width);
+            const Taps vy = makeTaps(src.height, dst.height);
+
+            std::vector<uint32_t> tmp;
+            horizontalPass<Simd>(src, hx, tmp, dst.width);
+            verticalPass<Simd>(tmp, dst.width, vy, dst);
+            return true;
+        }
+
+    } // namespace
+
+    bool resampleLanczos3(const ConstPixelBuffer& src, const PixelBuffer& dst)
+    {
+        return resample<true>(src, dst);
+    }
+
+    bool resampleLanczos3Scalar(const ConstPixelBuffer& src, const PixelBuffer& dst)
+    {
+        return resample<false>(src, dst);
+    }
+
+} // namespace manuscripta
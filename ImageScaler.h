@@ -0,0 +1,35 @@
+﻿#pragma once
+// ImageScaler.h — качественное масштабирование 32-битных пикселей (BGRA)
+// раздельным фильтром Ланцоша (a = 3).  Работает по «сырым» буферам,
+// без GDI: ReaderPanel масштабирует иллюстрацию один раз под размер
+// окна, а не через HALFTONE StretchBlt на каждой отрисовке.
+// Внутренние циклы — SSE2 (4 канала пикселя за операцию), на прочих
+// платформах — скалярный вариант.
+#include <cstddef>
+#include <cstdint>
+
+namespace manuscripta {
+
+    // stride — в пикселях (uint32_t), строки сверху вниз
+    struct PixelBuffer
+    {
+        uint32_t* pixels = nullptr;
+        int       width = 0;
+        int       height = 0;
+        size_t    stride = 0;
+    };
+
+    struct ConstPixelBuffer
+    {
+        const uint32_t* pixels = nullptr;
+        int             width = 0;
+        int             height = 0;
+        size_t          stride = 0;
+    };
+
+    // Масштабировать src целиком в dst целиком.  false — пустые размеры.
+    bool resampleLanczos3(const ConstPixelBuffer& src, const PixelBuffer& dst);
+    // То же без SIMD (для теста и сверки с SSE2)
+    bool resampleLanczos3Scalar(const ConstPixelBuffer& src, const PixelBuffer& dst);
+
+} // namespace manuscripta
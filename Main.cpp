@@ -2,10 +2,52 @@
 // cl /EHsc /DUNICODE /D_UNICODE Main.cpp MenuWindow.cpp user32.lib gdi32.lib comctl32.lib
 
 #include <windows.h>
+#include <shellapi.h>      // CommandLineToArgvW
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
 #include "MenuWindow.h"
+#include "ImageCache.h"
+#include "Prewarm.h"
+
+#pragma comment(lib, "shell32.lib")
+
+// Headless: Manuscripta.exe --prewarm book.txt [--concurrency N] ...
+// Every frame goes through fetchScene and ImageCache (download + decode),
+// both ending up in the disk cache the reader opens next time.
+static int runPrewarm(const std::vector<std::wstring>& args)
+{
+    // GUI subsystem: borrow the console we were started from
+    if (AttachConsole(ATTACH_PARENT_PROCESS) || AllocConsole()) {
+        FILE* f = nullptr;
+        freopen_s(&f, "CONOUT$", "w", stdout);
+        freopen_s(&f, "CONOUT$", "w", stderr);
+        SetConsoleOutputCP(CP_UTF8);
+    }
+
+    return manuscripta::prewarmMain(args, [](manuscripta::DiskCache& disk) -> manuscripta::ImageStage {
+        auto images = std::make_shared<ImageCache>();
+        images->AttachDiskCache(&disk);
+        return [images](const std::wstring& url) {
+            HBITMAP bmp = images->Get(url);
+            if (!bmp) return false;
+            images->Release(bmp);          // evictable; the file stays on disk
+            return true;
+            };
+        });
+}
 
 int APIENTRY wWinMain(HINSTANCE hInst, HINSTANCE, PWSTR, int nCmdShow)
 {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    std::vector<std::wstring> args;
+    for (int i = 1; argv && i < argc; ++i) args.emplace_back(argv[i]);
+    LocalFree(argv);
+    if (manuscripta::isPrewarmCommand(args))
+        return runPrewarm(args);
+
     SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
     MenuWindow menu(hInst);
     return menu.Run(nCmdShow);
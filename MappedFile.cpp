@@ -0,0 +1,120 @@
+﻿// MappedFile.cpp — отображение файла: Win32 и POSIX
+#include "MappedFile.h"
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace manuscripta {
+
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::wstring& path)
+    {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot open file");
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw std::runtime_error("Cannot open file");
+        }
+        if (size.QuadPart == 0) {           // пустой файл не отображается
+            CloseHandle(file);
+            return;
+        }
+        if (uint64_t(size.QuadPart) > SIZE_MAX) {
+            CloseHandle(file);
+            throw std::runtime_error("File too large");
+        }
+
+        // отображение держит файл, вид — отображение: дескрипторы не нужны
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) throw std::runtime_error("Cannot map file");
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view) throw std::runtime_error("Cannot map file");
+
+        _data = static_cast<const char*>(view);
+        _size = size_t(size.QuadPart);
+    }
+
+    void MappedFile::unmap()
+    {
+        if (_data) UnmapViewOfFile(_data);
+        _data = nullptr;
+        _size = 0;
+    }
+
+    void MappedFile::AdviseSequential() const
+    {
+        // FILE_FLAG_SEQUENTIAL_SCAN задан при открытии
+    }
+#else
+    MappedFile::MappedFile(const std::wstring& path)
+    {
+        const int fd = ::open(std::filesystem::path(path).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Cannot open file");
+
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            throw std::runtime_error("Cannot open file");
+        }
+        if (st.st_size == 0) {
+            ::close(fd);
+            return;
+        }
+
+        void* view = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);                        // отображение держит файл само
+        if (view == MAP_FAILED) throw std::runtime_error("Cannot map file");
+
+        _data = static_cast<const char*>(view);
+        _size = size_t(st.st_size);
+    }
+
+    void MappedFile::unmap()
+    {
+        if (_data) ::munmap(const_cast<char*>(_data), _size);
+        _data = nullptr;
+        _size = 0;
+    }
+
+    void MappedFile::AdviseSequential() const
+    {
+        if (_data) ::madvise(const_cast<char*>(_data), _size, MADV_SEQUENTIAL);
+    }
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        unmap();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+        : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0))
+    {
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            unmap();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+        }
+        return *this;
+    }
+
+} // namespace manuscripta
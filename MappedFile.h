@@ -0,0 +1,42 @@
+﻿#pragma once
+// MappedFile.h — файл книги, отображённый в память только для чтения
+// (MapViewOfFile / mmap).  Байты видны как string_view без единой
+// копии; в память подгружаются лишь страницы, которые реально читали,
+// и это страницы файлового кэша — под давлением ОС просто их сбросит.
+//
+// Файл, усечённый другим процессом, пока он отображён, даёт ошибку
+// страницы при чтении — книги во время чтения не переписывают.
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace manuscripta {
+
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        // std::runtime_error — файл не открылся / не отобразился
+        explicit MappedFile(const std::wstring& path);
+        ~MappedFile();
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::string_view Bytes() const { return { _data, _size }; }
+        size_t Size() const { return _size; }
+
+        // Читать будут подряд: упреждающее чтение крупнее, прочитанные
+        // страницы уходят первыми
+        void AdviseSequential() const;
+
+    private:
+        void unmap();
+
+        const char* _data = nullptr;        // пустой файл — nullptr
+        size_t      _size = 0;
+    };
+
+} // namespace manuscripta
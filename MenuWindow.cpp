@@ -11,6 +11,7 @@
 #include "Resource.h"       // ID кнопок
 #include "ImageCache.h"
 #include "SceneFetcher.h"
+#include "HttpClient.h"
 #include "config.h"
 #include <cmath>
 
@@ -106,6 +107,13 @@ void MenuWindow::paintMenu(HDC hdc)
 // ───────────────────────────────────────────────────────────
 MenuWindow::MenuWindow(HINSTANCE hInst) : _hInst(hInst)
 {
+    _imgCache.SetBudgetBytes(size_t(IMAGE_CACHE_BUDGET_MB) << 20);
+    if (_diskCache.Open(manuscripta::defaultCacheDirectory(), uint64_t(DISK_CACHE_BUDGET_MB) << 20))
+    {
+        _imgCache.AttachDiskCache(&_diskCache);
+        setSceneCache(&_diskCache);
+    }
+
     // 1) регистрируем класс окна
     WNDCLASSEX wc{ sizeof(wc) };
     wc.hInstance = _hInst;
@@ -136,6 +144,33 @@ MenuWindow::MenuWindow(HINSTANCE hInst) : _hInst(hInst)
 
 MenuWindow::~MenuWindow()
 {
+    _bookLoader.reset();                        // ждёт поток загрузки
+    stopSceneFetches();         // колбэки используют _imgCache и _reader
+    setSceneCache(nullptr);
+
+#ifdef _DEBUG
+    const manuscripta::HttpMetrics http = manuscripta::HttpClient::Shared().Metrics();
+    const uint64_t answered = http.newConnections + http.reusedConnections;
+    if (answered) {
+        wchar_t msg[256];
+        swprintf_s(msg, L"HTTP: %llu requests, %llu failed, reuse %.0f%%, avg ms: "
+            L"dns %.1f connect %.1f send %.1f wait %.1f read %.1f, max %.1f\n",
+            http.requests, http.failures, http.ReuseRate() * 100.0,
+            http.dnsUs / 1000.0 / answered, http.connectUs / 1000.0 / answered,
+            http.sendUs / 1000.0 / answered, http.waitUs / 1000.0 / answered,
+            http.readUs / 1000.0 / answered, http.maxTotalUs / 1000.0);
+        OutputDebugStringW(msg);
+    }
+    const SceneFetchStats scenes = sceneFetchStats();
+    if (scenes.requests) {
+        wchar_t msg[256];
+        swprintf_s(msg, L"Scenes: %llu fetched, %llu failed, %llu attempts, %llu retries, "
+            L"%llu timeouts, %llu breaker trips, %llu short-circuited\n",
+            scenes.succeeded, scenes.failed, scenes.attempts, scenes.retries,
+            http.timeouts, scenes.breakerTrips, scenes.shortCircuited);
+        OutputDebugStringW(msg);
+    }
+#endif
     DeleteObject(_fontTitle);
     DeleteObject(_fontSub);
     DeleteObject(_fontBtn);
@@ -146,26 +181,85 @@ MenuWindow::~MenuWindow()
 namespace
 {
     constexpr UINT WM_SET_BG = WM_USER + 1;    // передаём HBITMAP в ReaderPanel
+    constexpr UINT WM_BOOK_TEXT = WM_USER + 2;     // очередной блок книги прочитан
+    constexpr UINT WM_SCENE_SLOT = WM_USER + 3;    // запрос сцены кончился без картинки
     constexpr UINT IDT_SPINNER = 2;            // таймер для крутилки
+}
+
+void MenuWindow::reportOpenStage(const wchar_t* stage)
+{
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - _openStarted).count();
+    wchar_t msg[96];
+    swprintf_s(msg, L"Open: %s after %.1f ms\n", stage, ms);
+    OutputDebugStringW(msg);
+}
+
+//--------------------------------------------------------------------------
+// Открытие книги: файл читается блоками в фоновом потоке, UI-поток
+// дописывает их в читалку; до первого полного кадра крутится спиннер
+//--------------------------------------------------------------------------
+void MenuWindow::startOpen(const std::wstring& path)
+{
+    if (!_bookLoader)
+        _bookLoader = std::make_unique<manuscripta::BookLoader>(
+            [hwnd = _hWnd] { PostMessage(hwnd, WM_BOOK_TEXT, 0, 0); },
+            size_t(BOOK_CHUNK_KB) << 10);
+
+    _opening = true;
+    _openStarted = Clock::now();
+    _awaitFirstText = _awaitFirstScene = false;
+
+    if (!_reader)
+        _reader = std::make_unique<ReaderPanel>(_hInst, _hWnd, _imgCache);
+    _reader->BeginText(size_t(_bookLoader->Start(path)));
+}
+
+void MenuWindow::stopLoading()
+{
+    if (_bookLoader) _bookLoader->Cancel();
+    _opening = false;
+}
 
-    //-----------------------------------------------------------------------
-    // утилита: отправить сцену на асинхр. загрузку (если ещё не запрошена)
-    //-----------------------------------------------------------------------
-    void enqueueScene(ReaderPanel* reader,
-        ImageCache& cache,
-        HWND hwnd,
-        const std::wstring& chunk)
+void MenuWindow::onBookText()
+{
+    if (!_bookLoader || !_reader || !_bookLoader->Take(_bookChunk)) return;
+
+    _reader->AppendText(_bookChunk.file, _bookChunk.mapped, _bookChunk.text, _bookChunk.final);
+    if (_bookChunk.final)
+        reportOpenStage(L"book loaded");
+
+    if (!_bookChunk.error.empty())
     {
-        if (!reader || !reader->TryMarkFrameRequested(chunk))   // уже была
-            return;
+        const bool shown = !_opening;
+        if (!shown)
+        {
+            // до первого кадра не дошли — назад в меню
+            _reader.reset();
+            _opening = false;
+            KillTimer(_hWnd, IDT_SPINNER);
+            _forceSpinner = false;
+            _showSpinner = false;
+            ShowWindow(_btnOpen, SW_SHOW);
+            ShowWindow(_btnExit, SW_SHOW);
+            InvalidateRect(_hWnd, nullptr, FALSE);
+        }
+        MessageBoxW(_hWnd, _bookChunk.error.c_str(), L"MANUSCRIPTA", MB_OK | MB_ICONWARNING);
+        return;
+    }
 
-        fetchSceneAsync(chunk, [reader, &cache, hwnd](SceneApiResponse r)
-            {
-                if (r.imageUrl.empty())
-                    return;
-                if (HBITMAP bmp = cache.Get(r.imageUrl))
-                    PostMessage(hwnd, WM_SET_BG, reinterpret_cast<WPARAM>(bmp), 0);
-            });
+    // Reader is shown as soon as the first frame is complete; the first
+    // scene is requested like the frames ahead of it (AppendText →
+    // PrefetchScenes) and swapped in by WM_SET_BG when it arrives
+    if (_opening && (_reader->FrameCount() || _bookChunk.final))
+    {
+        _opening = false;
+        KillTimer(_hWnd, IDT_SPINNER);
+        _forceSpinner = false;
+        _showSpinner = false;
+        InvalidateRect(_hWnd, nullptr, FALSE);
+        reportOpenStage(L"first frame loaded");
+        _awaitFirstText = true;
+        _awaitFirstScene = _reader->FrameCount() != 0;
     }
 }
 
@@ -179,94 +273,22 @@ void MenuWindow::OnCommand(UINT id)
         // ──────────────────────────────────────────────────────────────────
     case ID_BTN_OPEN:
     {
+        if (_opening) break;
+
         // 1. Pick a text file ------------------------------------------------
         std::wstring path = selectTxtFile(_hWnd);
         if (path.empty()) break;
 
-        // 2. Ensure reader exists ------------------------------------------
-        if (!_reader)
-            _reader = std::make_unique<ReaderPanel>(_hInst, _hWnd);
-
-        std::wstring text = manuscripta::loadTextFileW(path);
-
-        // 3. Show spinner *before* blocking network / disk work -------------
+        // 2. Hide menu buttons, spin while the book loads -------------------
+        ShowWindow(_btnOpen, SW_HIDE);
+        ShowWindow(_btnExit, SW_HIDE);
         _forceSpinner = true;   // Hide logo, block ReaderPanel paint
         _showSpinner = true;
         SetTimer(_hWnd, IDT_SPINNER, 100, nullptr);
         InvalidateRect(_hWnd, nullptr, FALSE);
-        UpdateWindow(_hWnd);    // Immediate repaint so spinner is visible
-
-        // Give the spinner at least one WM_PAINT / WM_TIMER  tick
-        MSG m;
-        while (PeekMessage(&m, nullptr, 0, 0, PM_REMOVE))
-        {
-            TranslateMessage(&m);
-            DispatchMessage(&m);
-        }
-
-        // 4. Register frame‑change callback --------------------------------
-        _reader->SetOnFrameChange([this](const std::wstring& frame)
-            {
-                if (_reader->TryMarkFrameRequested(frame))
-                {
-                    fetchSceneAsync(frame, [this](SceneApiResponse scene)
-                        {
-                            if (!scene.imageUrl.empty())
-                            {
-                                if (HBITMAP bmp = _imgCache.Get(scene.imageUrl))
-                                    PostMessage(_hWnd, WM_USER + 1, (WPARAM)bmp, 0);
-                            }
-                        });
-                }
-            });
-
-        // 5. Feed the text (first frame will trigger the callback itself) ---
-        _reader->SetText(text);
-
-        // 6. Pre‑calculate first two chunks for scene fetching --------------
-        std::wstring scene1 = _reader->GetFrameText(0, SKIP_ENDS);
-        size_t nextStart = _reader->findNextParagraph(0, SKIP_ENDS);
-        std::wstring scene2 = _reader->GetFrameText(nextStart, SKIP_ENDS);
-
-        auto tryRequest = [this](const std::wstring& chunk)
-            {
-                if (_reader->TryMarkFrameRequested(chunk))
-                {
-                    fetchSceneAsync(chunk, [this](SceneApiResponse scene)
-                        {
-                            if (!scene.imageUrl.empty())
-                            {
-                                if (HBITMAP bmp = _imgCache.Get(scene.imageUrl))
-                                    PostMessage(_hWnd, WM_USER + 1, (WPARAM)bmp, 0);
-                            }
-                        });
-                }
-            };
-
-        // 7. Synchronous fetch for the very first scene ---------------------
-        if (_reader->TryMarkFrameRequested(scene1))
-        {
-            SceneApiResponse first = fetchScene(scene1);
-            if (!first.imageUrl.empty())
-            {
-                if (HBITMAP bmp = _imgCache.Get(first.imageUrl))
-                    _reader->SetBackground(bmp);
-            }
-        }
-
-        // 8. Kick off asynchronous fetches for scene1 / scene2 -------------
-        tryRequest(scene1);
-        tryRequest(scene2);
-
-        // 9. Hide spinner & reveal reader panel ----------------------------
-        KillTimer(_hWnd, IDT_SPINNER);
-        _forceSpinner = false;
-        _showSpinner = false;
-        InvalidateRect(_hWnd, nullptr, FALSE);
 
-        // 10. Hide menu buttons ---------------------------------------------
-        ShowWindow(_btnOpen, SW_HIDE);
-        ShowWindow(_btnExit, SW_HIDE);
+        // 3. Stream the book in off the UI thread (WM_BOOK_TEXT) -----------
+        startOpen(path);
         break;
     }
 
@@ -322,7 +344,14 @@ LRESULT CALLBACK MenuWindow::WndProc(HWND hWnd, UINT msg,
     {
         PAINTSTRUCT ps; HDC hdc = BeginPaint(hWnd, &ps);
         if (self->_reader && self->_reader->IsActive() && !self->_forceSpinner)
+        {
             self->_reader->OnPaint(hdc);
+            if (self->_awaitFirstText)
+            {
+                self->_awaitFirstText = false;
+                self->reportOpenStage(L"first text");
+            }
+        }
         else
             self->paintMenu(hdc);
         EndPaint(hWnd, &ps);
@@ -360,6 +389,7 @@ LRESULT CALLBACK MenuWindow::WndProc(HWND hWnd, UINT msg,
             // панель закрылась → возвращаем меню
             if (!self->_reader->IsActive())
             {
+                self->stopLoading();        // закрыли, не дочитав книгу
                 self->_reader.reset();
                 ShowWindow(self->_btnOpen, SW_SHOW);
                 ShowWindow(self->_btnExit, SW_SHOW);
@@ -368,12 +398,16 @@ LRESULT CALLBACK MenuWindow::WndProc(HWND hWnd, UINT msg,
         }
         break;
 
-    case WM_USER + 1: // пришла картинка
+    case WM_SET_BG: // пришла картинка
     {
         HBITMAP bmp = (HBITMAP)wParam;
         if (self->_reader)
         {
-            self->_reader->SetBackground(bmp);
+            if (self->_reader->OnSceneReady(bmp, size_t(lParam)) && self->_awaitFirstScene)
+            {
+                self->_awaitFirstScene = false;
+                self->reportOpenStage(L"first scene");
+            }
 
             // выключаем спиннер, включаем рендер ReaderPanel
             self->_forceSpinner = false;
@@ -382,9 +416,22 @@ LRESULT CALLBACK MenuWindow::WndProc(HWND hWnd, UINT msg,
 
             InvalidateRect(self->_hWnd, nullptr, FALSE);
         }
+        else
+        {
+            self->_imgCache.Release(bmp);   // читалку уже закрыли
+        }
         return 0;
     }
 
+    case WM_BOOK_TEXT:
+        self->onBookText();
+        return 0;
+
+    case WM_SCENE_SLOT: // место в бюджете сцен свободно — дозапросить окно
+        if (self->_reader && self->_reader->IsActive())
+            self->_reader->OnSceneFailed(size_t(lParam));
+        return 0;
+
     case WM_SIZE:
         if (self->_reader)
         {
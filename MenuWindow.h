@@ -3,8 +3,11 @@
 #include <windows.h>
 #include <memory>          // std::unique_ptr
 #include "ReaderPanel.h"
+#include <chrono>
 #include <string>
 #include "ImageCache.h"
+#include "DiskCache.h"
+#include "BookLoader.h"
 
 class MenuWindow
 {
@@ -15,12 +18,12 @@ public:
     int Run(int nCmdShow);
 
 private:
-    bool _frameCbRegistered{ false };
     bool _forceSpinner = false;
     bool _showSpinner = false;
     int  _spinnerAngle = 0;
     // Internal helpers
-    ImageCache _imgCache;
+    manuscripta::DiskCache _diskCache;  // illustrations + scene URLs between sessions
+    ImageCache _imgCache;               // shared with ReaderPanel, outlives it
     void RegisterClass();
     void CreateMainWindow(int nCmdShow);
 
@@ -45,6 +48,25 @@ private:
 
     std::unique_ptr<ReaderPanel> _reader;
 
+    // Opening a book never blocks the UI thread: _bookLoader streams the
+    // file in chunks (WM_BOOK_TEXT), the reader shows up as soon as the
+    // first frame is complete and keeps growing while the rest loads;
+    // the first scene arrives like any other.
+    std::unique_ptr<manuscripta::BookLoader> _bookLoader;
+    manuscripta::BookLoader::Chunk _bookChunk;   // reused between chunks
+    bool _opening = false;              // spinner until the first frame
+    void startOpen(const std::wstring& path);
+    void onBookText();
+    void stopLoading();
+
+    // Open latency, written to the debugger output:
+    // click → book loaded → first text on screen → first scene
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point _openStarted{};
+    bool _awaitFirstText = false;
+    bool _awaitFirstScene = false;
+    void reportOpenStage(const wchar_t* stage);
+
     // helpers
     void paintMenu(HDC hdc);
     HWND createButton(UINT id, int y, LPCWSTR text);
@@ -0,0 +1,206 @@
+﻿// NewlineScan.cpp — векторный поиск '\n' + проверка разрыва абзаца
+#include "NewlineScan.h"
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MANUSCRIPTA_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MANUSCRIPTA_AVX2_FN
+#else
+#define MANUSCRIPTA_AVX2_FN __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace manuscripta {
+
+    namespace {
+
+        enum class Isa { Scalar, Sse2, Avx2 };
+
+#ifdef MANUSCRIPTA_X86
+        Isa detectIsa()
+        {
+#ifdef _MSC_VER
+            int r[4]{};
+            __cpuid(r, 0);
+            if (r[0] < 7) return Isa::Sse2;
+            __cpuid(r, 1);
+            const bool osxsave = (r[2] & (1 << 27)) != 0;
+            const bool avx = (r[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return Isa::Sse2;
+            __cpuidex(r, 7, 0);
+            return (r[1] & (1 << 5)) ? Isa::Avx2 : Isa::Sse2;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? Isa::Avx2 : Isa::Sse2;
+#endif
+        }
+
+        inline unsigned lowestBit(uint32_t m)
+        {
+#ifdef _MSC_VER
+            unsigned long i; _BitScanForward(&i, m); return i;
+#else
+            return static_cast<unsigned>(__builtin_ctz(m));
+#endif
+        }
+
+        template <size_t Unit> __m128i cmpNl128(__m128i v, __m128i nl);
+        template <> __m128i cmpNl128<1>(__m128i v, __m128i nl) { return _mm_cmpeq_epi8(v, nl); }
+        template <> __m128i cmpNl128<2>(__m128i v, __m128i nl) { return _mm_cmpeq_epi16(v, nl); }
+        template <> __m128i cmpNl128<4>(__m128i v, __m128i nl) { return _mm_cmpeq_epi32(v, nl); }
+
+        template <class Ch> __m128i splatNl128()
+        {
+            if constexpr (sizeof(Ch) == 1) return _mm_set1_epi8('\n');
+            else if constexpr (sizeof(Ch) == 2) return _mm_set1_epi16('\n');
+            else return _mm_set1_epi32('\n');
+        }
+
+        // 16 байт за шаг
+        template <class Ch>
+        size_t findNewlineSse2(const Ch* p, size_t len, size_t pos)
+        {
+            constexpr size_t step = 16 / sizeof(Ch);
+            const __m128i nl = splatNl128<Ch>();
+            for (; pos + step <= len; pos += step)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + pos));
+                uint32_t m = static_cast<uint32_t>(_mm_movemask_epi8(cmpNl128<sizeof(Ch)>(v, nl)));
+                if (m) return pos + lowestBit(m) / sizeof(Ch);
+            }
+            for (; pos < len; ++pos)
+                if (p[pos] == Ch('\n')) return pos;
+            return len;
+        }
+
+        // 32 байта за шаг
+        template <class Ch>
+        MANUSCRIPTA_AVX2_FN size_t findNewlineAvx2(const Ch* p, size_t len, size_t pos)
+        {
+            constexpr size_t step = 32 / sizeof(Ch);
+            __m256i nl;
+            if constexpr (sizeof(Ch) == 1) nl = _mm256_set1_epi8('\n');
+            else if constexpr (sizeof(Ch) == 2) nl = _mm256_set1_epi16('\n');
+            else nl = _mm256_set1_epi32('\n');
+
+            for (; pos + step <= len; pos += step)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + pos));
+                __m256i eq;
+                if constexpr (sizeof(Ch) == 1) eq = _mm256_cmpeq_epi8(v, nl);
+                else if constexpr (sizeof(Ch) == 2) eq = _mm256_cmpeq_epi16(v, nl);
+                else eq = _mm256_cmpeq_epi32(v, nl);
+                uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+                if (m) return pos + lowestBit(m) / sizeof(Ch);
+            }
+            return findNewlineSse2(p, len, pos);
+        }
+#endif
+
+        template <class Ch>
+        size_t findNewlineScalar(const Ch* p, size_t len, size_t pos)
+        {
+            for (; pos < len; ++pos)
+                if (p[pos] == Ch('\n')) return pos;
+            return len;
+        }
+
+        template <class Ch>
+        size_t findNewline(const Ch* p, size_t len, size_t pos)
+        {
+#ifdef MANUSCRIPTA_X86
+            static const Isa isa = detectIsa();
+            if (isa == Isa::Avx2) return findNewlineAvx2(p, len, pos);
+            return findNewlineSse2(p, len, pos);
+#else
+            return findNewlineScalar(p, len, pos);
+#endif
+        }
+
+        // Любой разрыв содержит '\n' в первой или второй позиции, значит
+        // до (q - 1), где q — ближайший '\n', совпадений быть не может.
+        template <class Ch>
+        size_t findBreak(const Ch* p, size_t len, size_t pos, unsigned& breakLen)
+        {
+            while (pos < len)
+            {
+                size_t q = findNewline(p, len, pos);
+                if (q >= len) break;
+
+                if (q > pos && q + 2 < len &&
+                    p[q - 1] == Ch('\r') && p[q + 1] == Ch('\r') && p[q + 2] == Ch('\n')) {
+                    breakLen = 4;
+                    return q - 1;
+                }
+                if (q + 1 < len && p[q + 1] == Ch('\n')) {
+                    breakLen = 2;
+                    return q;
+                }
+                pos = q + 1;
+            }
+            breakLen = 0;
+            return len;
+        }
+
+        template <class Ch>
+        size_t findBreakScalar(const Ch* p, size_t len, size_t pos, unsigned& breakLen)
+        {
+            for (; pos < len; ++pos)
+            {
+                if (pos + 1 < len && p[pos] == Ch('\n') && p[pos + 1] == Ch('\n')) {
+                    breakLen = 2;
+                    return pos;
+                }
+                if (pos + 3 < len &&
+                    p[pos] == Ch('\r') && p[pos + 1] == Ch('\n') &&
+                    p[pos + 2] == Ch('\r') && p[pos + 3] == Ch('\n')) {
+                    breakLen = 4;
+                    return pos;
+                }
+            }
+            breakLen = 0;
+            return len;
+        }
+
+    } // namespace
+
+    size_t findParagraphBreak(const char* text, size_t len, size_t from, unsigned& breakLen)
+    {
+        return findBreak(text, len, from, breakLen);
+    }
+    size_t findParagraphBreak(const char16_t* text, size_t len, size_t from, unsigned& breakLen)
+    {
+        return findBreak(text, len, from, breakLen);
+    }
+    size_t findParagraphBreak(const wchar_t* text, size_t len, size_t from, unsigned& breakLen)
+    {
+        return findBreak(text, len, from, breakLen);
+    }
+
+    size_t findParagraphBreakScalar(const char* text, size_t len, size_t from, unsigned& breakLen)
+    {
+        return findBreakScalar(text, len, from, breakLen);
+    }
+    size_t findParagraphBreakScalar(const char16_t* text, size_t len, size_t from, unsigned& breakLen)
+    {
+        return findBreakScalar(text, len, from, breakLen);
+    }
+    size_t findParagraphBreakScalar(const wchar_t* text, size_t len, size_t from, unsigned& breakLen)
+    {
+        return findBreakScalar(text, len, from, breakLen);
+    }
+
+    const char* newlineScanIsa()
+    {
+#ifdef MANUSCRIPTA_X86
+        static const Isa isa = detectIsa();
+        return isa == Isa::Avx2 ? "avx2" : "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+} // namespace manuscripta
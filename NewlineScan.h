@@ -0,0 +1,27 @@
+﻿#pragma once
+// NewlineScan.h — поиск разрывов абзацев (\n\n, \r\n\r\n) блоками по 16/32
+// байта (SSE2 / AVX2, выбор в рантайме) со скалярным запасным вариантом.
+// Работает по UTF-16 (wchar_t на Windows / char16_t) и по UTF-8 байтам:
+// '\n' и '\r' в обеих кодировках никогда не встречаются внутри
+// многобайтовых последовательностей.
+#include <cstddef>
+
+namespace manuscripta {
+
+    // Начало ближайшего разрыва абзаца в [from, len) — ровно с той же
+    // семантикой, что у посимвольного цикла ReaderPanel: в каждой позиции
+    // сначала \n\n, затем \r\n\r\n.  breakLen ← 2 или 4.
+    // Нет разрыва → len (breakLen = 0).
+    size_t findParagraphBreak(const char* text, size_t len, size_t from, unsigned& breakLen);
+    size_t findParagraphBreak(const char16_t* text, size_t len, size_t from, unsigned& breakLen);
+    size_t findParagraphBreak(const wchar_t* text, size_t len, size_t from, unsigned& breakLen);
+
+    // Посимвольная эталонная версия (для бенчмарка и сверки)
+    size_t findParagraphBreakScalar(const char* text, size_t len, size_t from, unsigned& breakLen);
+    size_t findParagraphBreakScalar(const char16_t* text, size_t len, size_t from, unsigned& breakLen);
+    size_t findParagraphBreakScalar(const wchar_t* text, size_t len, size_t from, unsigned& breakLen);
+
+    // Какая реализация выбрана на этой машине: "avx2", "sse2" или "scalar"
+    const char* newlineScanIsa();
+
+} // namespace manuscripta
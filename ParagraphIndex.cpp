@@ -0,0 +1,112 @@
+﻿// ParagraphIndex.cpp — таблица абзацев / кадров
+#include "ParagraphIndex.h"
+#include "NewlineScan.h"
+#include <algorithm>
+
+namespace manuscripta {
+
+    void ParagraphIndex::Clear()
+    {
+        _breakBegin.clear();
+        _breakLen.clear();
+        _frames.clear();
+        _length = 0;
+        _scanFrom = 0;
+        _frameFrom = 0;
+        _complete = true;
+    }
+
+    void ParagraphIndex::Build(std::wstring_view text, int parasPerFrame)
+    {
+        Clear();
+        extend(text, parasPerFrame, true);
+    }
+
+    void ParagraphIndex::Build(std::string_view utf8, int parasPerFrame)
+    {
+        Clear();
+        extend(utf8, parasPerFrame, true);
+    }
+
+    void ParagraphIndex::Extend(std::wstring_view text, int parasPerFrame, bool final)
+    {
+        extend(text, parasPerFrame, final);
+    }
+
+    void ParagraphIndex::Extend(std::string_view utf8, int parasPerFrame, bool final)
+    {
+        extend(utf8, parasPerFrame, final);
+    }
+
+    template <class Ch>
+    void ParagraphIndex::extend(std::basic_string_view<Ch> text, int parasPerFrame, bool final)
+    {
+        _length = text.size();
+        _complete = final;
+
+        // ─── 1. разрывы абзацев — один проход (findParagraphBreak ищет
+        //        '\n' блоками SIMD, семантика — как у старого цикла) ───
+        size_t pos = _scanFrom;
+        while (pos < _length)
+        {
+            unsigned len = 0;
+            size_t at = findParagraphBreak(text.data(), _length, pos, len);
+            if (!len) break;
+            _breakBegin.push_back(at);
+            _breakLen.push_back(static_cast<unsigned char>(len));
+            pos = at + len;
+        }
+        // разрыв, оборванный концом блока (\r\n\r…), найдётся со
+        // следующим блоком: отступаем на 3 символа назад
+        _scanFrom = std::max(pos, _length >= 3 ? _length - 3 : 0);
+
+        // ─── 2. кадры: конец = +parasPerFrame абзацев, следующий кадр
+        //        начинается после пробелов / табов (но не \n) ───
+        while (_frames.empty() || _frames.back().end > _frames.back().start)
+        {
+            size_t start = _frameFrom;
+            if (!_frames.empty())
+                while (start < _length && (text[start] == Ch(' ') || text[start] == Ch('\t')))
+                    ++start;
+            if (start >= _length) break;
+
+            // пока текст не весь, кадр полон, только если его закрыл разрыв
+            if (!final && parasPerFrame > 0) {
+                auto it = std::lower_bound(_breakBegin.begin(), _breakBegin.end(), start);
+                if (size_t(it - _breakBegin.begin()) + (parasPerFrame - 1) >= _breakBegin.size())
+                    break;
+            }
+
+            size_t end = NextParagraph(start, parasPerFrame);
+            _frames.push_back({ start, end });
+            _frameFrom = end;
+        }
+    }
+
+    size_t ParagraphIndex::NextParagraph(size_t start, int count) const
+    {
+        if (count <= 0 || start >= _length)
+            return std::min(start, _length);
+
+        auto it = std::lower_bound(_breakBegin.begin(), _breakBegin.end(), start);
+        size_t i = static_cast<size_t>(it - _breakBegin.begin()) + (count - 1);
+        if (i >= _breakBegin.size())
+            return _length;                     // абзацев не хватило — до конца текста
+        return _breakBegin[i] + _breakLen[i];
+    }
+
+    size_t ParagraphIndex::ParagraphEnd(size_t start) const
+    {
+        auto it = std::lower_bound(_breakBegin.begin(), _breakBegin.end(), start);
+        return it != _breakBegin.end() ? *it : _length;
+    }
+
+    size_t ParagraphIndex::FrameAt(size_t pos) const
+    {
+        if (_frames.empty()) return 0;
+        auto it = std::upper_bound(_frames.begin(), _frames.end(), pos,
+            [](size_t p, const FrameSpan& f) { return p < f.start; });
+        return it == _frames.begin() ? 0 : static_cast<size_t>(it - _frames.begin()) - 1;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,64 @@
+﻿#pragma once
+// ParagraphIndex.h — одноразовая разметка текста на абзацы и кадры.
+// Строится по мере загрузки книги (ReaderPanel::AppendText) прямо по
+// байтам UTF-8 из TextStore; все дальнейшие запросы границ
+// кадра — O(1) / O(log n) вместо посимвольного прохода по тексту.
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace manuscripta {
+
+    // Кадр — SKIP_ENDS абзацев подряд, [start, end)
+    struct FrameSpan
+    {
+        size_t start = 0;   // первый символ кадра
+        size_t end = 0;     // конец кадра (не включая)
+    };
+
+    class ParagraphIndex
+    {
+    public:
+        // Найти все разрывы абзацев (\n\n и \r\n\r\n) и нарезать кадры
+        // по parasPerFrame абзацев — ровно так, как это делал OnTimer.
+        void Build(std::wstring_view text, int parasPerFrame);
+        void Build(std::string_view utf8, int parasPerFrame);   // позиции — в байтах
+        void Clear();
+
+        // Потоковая загрузка: text — всё прочитанное на сейчас (прежний
+        // text плюс новый хвост), сканируется только хвост.  Пока
+        // final == false, текст после последнего полного кадра кадром
+        // не считается — он может продолжиться в следующем блоке.
+        void Extend(std::wstring_view text, int parasPerFrame, bool final);
+        void Extend(std::string_view utf8, int parasPerFrame, bool final);
+        bool Complete() const { return _complete; }
+
+        // То же, что прежний ReaderPanel::findNextParagraph: позиция
+        // сразу ПОСЛЕ count-го разрыва, начиная со start.
+        // start должен лежать на границе кадра/абзаца (не внутри \r\n\r\n).
+        size_t NextParagraph(size_t start, int count) const;
+
+        // Индекс первого символа разрыва, начинающегося не раньше start.
+        size_t ParagraphEnd(size_t start) const;
+
+        size_t ParagraphCount() const { return _breakBegin.size() + 1; }
+        size_t FrameCount() const { return _frames.size(); }
+        const FrameSpan& Frame(size_t n) const { return _frames[n]; }
+
+        // Номер кадра, которому принадлежит символ pos
+        size_t FrameAt(size_t pos) const;
+
+    private:
+        template <class Ch>
+        void extend(std::basic_string_view<Ch> text, int parasPerFrame, bool final);
+
+        std::vector<size_t>        _breakBegin;   // начало каждого разрыва
+        std::vector<unsigned char> _breakLen;     // 2 (\n\n) или 4 (\r\n\r\n)
+        std::vector<FrameSpan>     _frames;
+        size_t                     _length = 0;
+        size_t                     _scanFrom = 0;    // разрывы до него уже найдены
+        size_t                     _frameFrom = 0;   // конец последнего полного кадра
+        bool                       _complete = true;
+    };
+
+} // namespace manuscripta
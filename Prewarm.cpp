@@ -0,0 +1,269 @@
+﻿// Prewarm.cpp — нарезка книги на кадры и параллельный прогон
+// fetchScene → кэш картинок
+#include "Prewarm.h"
+#include "DiskCache.h"
+#include "FileLoader.h"
+#include "Hash.h"
+#include "HttpClient.h"
+#include "MappedFile.h"
+#include "ParagraphIndex.h"
+#include "SceneFetcher.h"
+#include "Utf8.h"
+#include "WorkerPool.h"
+#include "config.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cwchar>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+
+namespace manuscripta {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        double secondsSince(Clock::time_point t)
+        {
+            return std::chrono::duration<double>(Clock::now() - t).count();
+        }
+
+        void usage()
+        {
+            std::fprintf(stderr,
+                "usage: --prewarm <book.txt> [--concurrency N] "
+                "[--server host[:port][/path]]... [--cache <dir>]\n");
+        }
+    }
+
+    std::vector<std::wstring> splitFrames(const std::wstring& text, int parasPerFrame)
+    {
+        ParagraphIndex index;
+        index.Build(text, parasPerFrame);
+
+        std::vector<std::wstring> frames;
+        frames.reserve(index.FrameCount());
+        for (size_t n = 0; n < index.FrameCount(); ++n) {
+            const FrameSpan& f = index.Frame(n);
+            frames.push_back(text.substr(f.start, f.end - f.start));
+        }
+        return frames;
+    }
+
+    BookFrames::BookFrames(const std::wstring& path, int parasPerFrame)
+        : _file(path)
+    {
+        _file.AdviseSequential();
+        const std::string_view bytes = _file.Bytes();
+        _index.Build(bytes, parasPerFrame);
+        _utf8 = utf8Valid(bytes);           // не UTF-8 — вся книга в ANSI
+    }
+
+    std::string_view BookFrames::Bytes(size_t n) const
+    {
+        const FrameSpan& f = _index.Frame(n);
+        return _file.Bytes().substr(f.start, f.end - f.start);
+    }
+
+    std::wstring BookFrames::Frame(size_t n) const
+    {
+        std::wstring out;
+        decodeBookBytes(Bytes(n), _utf8, out);
+        return out;
+    }
+
+    namespace {
+        // jobs — номера кадров без пустых и повторов; text(n) — кадр n,
+        // зовётся в рабочем потоке
+        PrewarmStats prewarmJobs(const std::vector<size_t>& jobs,
+            const std::function<std::wstring(size_t)>& text, unsigned concurrency,
+            const ImageStage& image, const PrewarmProgress& progress)
+        {
+            concurrency = std::max(1u, concurrency);
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            PrewarmStats stats;
+            stats.frames = jobs.size();
+            size_t outstanding = 0;                    // в очереди + в работе
+            const size_t window = size_t(concurrency) * 2;
+            const Clock::time_point start = Clock::now();
+
+            auto finish = [&](bool scene, bool img) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++stats.done;
+                    if (scene) ++stats.scenes;
+                    if (img) ++stats.images;
+                    stats.seconds = secondsSince(start);
+                    --outstanding;
+                    if (progress) progress(stats);
+                }
+                cv.notify_all();
+                };
+
+            {
+                WorkerPool pool(concurrency, window);
+                for (const size_t n : jobs)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cv.wait(lock, [&] { return outstanding < window; });
+                        ++outstanding;
+                    }
+                    // приоритет у всех один — кадры идут в порядке книги
+                    auto run = [n, &text, &image, &finish] {
+                        // картинка — через fetchScene: пропавшую по адресу из
+                        // кэша сцен он запросит заново
+                        bool img = false;
+                        SceneImageLoader load;
+                        if (image) load = [&](const std::wstring& url) { return img = image(url); };
+                        const SceneApiResponse scene = fetchScene(text(n), {}, load);
+                        finish(!scene.imageUrl.empty(), img);
+                        };
+                    if (!pool.Submit(0, std::move(run), [&finish] { finish(false, false); }))
+                        finish(false, false);
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return outstanding == 0; });
+            }
+
+            stats.seconds = secondsSince(start);
+            return stats;
+        }
+    }
+
+    PrewarmStats prewarmFrames(const std::vector<std::wstring>& frames, unsigned concurrency,
+        const ImageStage& image, const PrewarmProgress& progress)
+    {
+        std::vector<size_t> jobs;
+        std::unordered_set<std::wstring_view> seen;
+        for (size_t n = 0; n < frames.size(); ++n)
+            if (!frames[n].empty() && seen.insert(frames[n]).second) jobs.push_back(n);
+
+        return prewarmJobs(jobs, [&frames](size_t n) { return frames[n]; },
+            concurrency, image, progress);
+    }
+
+    PrewarmStats prewarmFrames(const BookFrames& book, unsigned concurrency,
+        const ImageStage& image, const PrewarmProgress& progress)
+    {
+        // повтор узнаём по байтам: одна кодировка — один и тот же текст
+        std::vector<size_t> jobs;
+        std::unordered_set<std::string_view> seen;
+        for (size_t n = 0; n < book.Count(); ++n) {
+            const std::string_view bytes = book.Bytes(n);
+            if (!bytes.empty() && seen.insert(bytes).second) jobs.push_back(n);
+        }
+
+        return prewarmJobs(jobs, [&book](size_t n) { return book.Frame(n); },
+            concurrency, image, progress);
+    }
+
+    ImageStage diskImageStage(DiskCache& disk)
+    {
+        return [&disk](const std::wstring& url) {
+            const std::string key = "img-" + hashHex(hash64(wideToUtf8(url)));
+            std::filesystem::path file;
+            if (disk.Lookup(key, file)) return true;   // скачана прошлым прогоном
+
+            HttpResponse http;
+            if (!HttpClient::Shared().Get(url, http) || !http.Ok() || http.body.empty())
+                return false;
+            return disk.Write(key, http.body);
+            };
+    }
+
+    bool isPrewarmCommand(const std::vector<std::wstring>& args)
+    {
+        return std::find(args.begin(), args.end(), L"--prewarm") != args.end();
+    }
+
+    int prewarmMain(const std::vector<std::wstring>& args,
+        const std::function<ImageStage(DiskCache&)>& makeImage)
+    {
+        std::wstring book;
+        std::filesystem::path cacheDir = defaultCacheDirectory();
+        unsigned concurrency = SCENE_WORKERS;
+        std::vector<SceneEndpoint> endpoints;   // пусто — как настроено (по умолчанию)
+
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const std::wstring& a = args[i];
+            const bool hasValue = i + 1 < args.size();
+            if (a == L"--prewarm" && hasValue) book = args[++i];
+            else if (a == L"--concurrency" && hasValue)
+                concurrency = unsigned(std::wcstoul(args[++i].c_str(), nullptr, 10));
+            else if (a == L"--server" && hasValue) {
+                SceneEndpoint ep;
+                if (!parseSceneEndpoint(args[++i], ep)) { usage(); return 2; }
+                endpoints.push_back(ep);
+            }
+            else if (a == L"--cache" && hasValue) cacheDir = args[++i];
+            else { usage(); return 2; }
+        }
+        if (book.empty() || concurrency == 0) { usage(); return 2; }
+
+        std::unique_ptr<BookFrames> frames;
+        try { frames = std::make_unique<BookFrames>(book, SKIP_ENDS); }
+        catch (const std::exception& e) {
+            std::fprintf(stderr, "%s: %s\n", wideToUtf8(book).c_str(), e.what());
+            return 1;
+        }
+
+        DiskCache disk;
+        if (!disk.Open(cacheDir, uint64_t(DISK_CACHE_BUDGET_MB) << 20)) {
+            std::fprintf(stderr, "cannot open cache %s\n", wideToUtf8(cacheDir.wstring()).c_str());
+            return 1;
+        }
+        if (!endpoints.empty()) setSceneEndpoints(endpoints);
+        const SceneEndpoint endpoint = sceneEndpoint();
+        const size_t fallbacks = sceneEndpoints().size() - 1;
+        setSceneCache(&disk);
+        HttpClient::Shared().SetMaxConnsPerHost(concurrency);
+
+        std::printf("%s: %zu frames -> %s:%u%s (+%zu fallback), %u at a time\n",
+            wideToUtf8(book).c_str(), frames->Count(),
+            wideToUtf8(endpoint.host).c_str(), unsigned(endpoint.port),
+            wideToUtf8(endpoint.path).c_str(), fallbacks, concurrency);
+        std::fflush(stdout);
+
+        PrewarmStats stats;
+        {
+            ImageStage image = makeImage(disk);
+
+            // не чаще 5 раз в секунду, последний — всегда
+            double lastReport = -1.0;
+            stats = prewarmFrames(*frames, concurrency, image, [&](const PrewarmStats& s) {
+                if (s.done < s.frames && s.seconds - lastReport < 0.2) return;
+                lastReport = s.seconds;
+                std::fprintf(stderr, "\r%zu/%zu frames  %.1f frames/s  failed %zu   ",
+                    s.done, s.frames, s.FramesPerSecond(), s.Failed());
+                std::fflush(stderr);
+                });
+        }
+        std::fprintf(stderr, "\n");
+
+        setSceneCache(nullptr);
+        disk.WaitIdle();
+
+        const HttpMetrics m = HttpClient::Shared().Metrics();
+        std::printf("%zu frames in %.1f s (%.2f frames/s): %zu scenes, %zu images, %zu failed; "
+            "%.0f%% connections reused\n",
+            stats.done, stats.seconds, stats.FramesPerSecond(),
+            stats.scenes, stats.images, stats.Failed(), m.ReuseRate() * 100.0);
+        const SceneFetchStats f = sceneFetchStats();
+        std::printf("scene API: %llu attempts, %llu retries, %llu timeouts, "
+            "%llu breaker trips, %llu short-circuited\n",
+            (unsigned long long)f.attempts, (unsigned long long)f.retries,
+            (unsigned long long)m.timeouts, (unsigned long long)f.breakerTrips,
+            (unsigned long long)f.shortCircuited);
+        return stats.Failed() ? 1 : 0;
+    }
+
+} // namespace manuscripta
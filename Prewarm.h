@@ -0,0 +1,94 @@
+﻿#pragma once
+// Prewarm.h — пакетная подготовка иллюстраций книги без окна.
+// Книга режется на кадры ровно как в ReaderPanel (SKIP_ENDS абзацев
+// через ParagraphIndex); каждый кадр проходит fetchScene, затем его
+// картинка попадает в кэш.  Кадры идут параллельно на WorkerPool, и
+// читалка потом берёт и сцены, и картинки из DiskCache.
+//
+//   Manuscripta.exe --prewarm book.txt [--concurrency N]
+//                   [--server host[:port][/path]]... [--cache dir]
+//
+// --server можно повторить: запасные серверы в порядке перебора.
+//
+// На Linux — tools/PrewarmCli.cpp: картинки скачиваются в DiskCache
+// без декодирования (GDI+ там нет).
+#include "MappedFile.h"
+#include "ParagraphIndex.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace manuscripta {
+
+    class DiskCache;
+
+    struct PrewarmStats
+    {
+        size_t frames = 0;      // кадров к обработке (без пустых и повторов)
+        size_t done = 0;        // обработано — успешно или нет
+        size_t scenes = 0;      // сервер сцен вернул URL картинки
+        size_t images = 0;      // картинка в кэше
+        double seconds = 0;
+
+        size_t Failed() const { return done - images; }
+        double FramesPerSecond() const { return seconds > 0 ? double(done) / seconds : 0.0; }
+    };
+
+    // URL сцены → картинка в кэше; false — не получилось
+    using ImageStage = std::function<bool(const std::wstring& url)>;
+    using PrewarmProgress = std::function<void(const PrewarmStats&)>;
+
+    // Кадры книги — те же, что ReaderPanel::GetFrame(0..FrameCount())
+    std::vector<std::wstring> splitFrames(const std::wstring& text, int parasPerFrame);
+
+    // Те же кадры прямо из файла.  loadTextFileW тут не годится: он
+    // собрал бы всю книгу в UTF-16 (2–4 байта на символ) только затем,
+    // чтобы её нарезать.  Здесь файл отображён, кадры размечены по его
+    // байтам ('\n' / '\r' не встречаются внутри символов ни UTF-8, ни
+    // ANSI), а в wstring переводится один кадр, когда он нужен.
+    // Кодировка — как у loadTextFileW: весь файл валидный UTF-8, иначе
+    // ANSI (Windows-1251 вне Windows); проверка UTF-8 ничего не копирует.
+    class BookFrames
+    {
+    public:
+        // std::runtime_error — файл не открылся
+        BookFrames(const std::wstring& path, int parasPerFrame);
+
+        size_t Count() const { return _index.FrameCount(); }
+        std::string_view Bytes(size_t n) const;     // кадр n как есть в файле
+        std::wstring Frame(size_t n) const;
+
+    private:
+        MappedFile     _file;
+        ParagraphIndex _index;
+        bool           _utf8 = true;
+    };
+
+    // concurrency кадров одновременно; очередь держит не больше
+    // 2 × concurrency, так что книга любого размера не раздувает память.
+    // Пустые и повторяющиеся кадры пропускаются, как в requestScene.
+    // progress вызывается после каждого кадра из рабочих потоков,
+    // по одному за раз.
+    PrewarmStats prewarmFrames(const std::vector<std::wstring>& frames, unsigned concurrency,
+        const ImageStage& image, const PrewarmProgress& progress = {});
+    // То же для книги из файла: кадр перекодируется в рабочем потоке —
+    // в UTF-16 в памяти только кадры в работе
+    PrewarmStats prewarmFrames(const BookFrames& book, unsigned concurrency,
+        const ImageStage& image, const PrewarmProgress& progress = {});
+
+    // Картинка → disk под ключом ImageCache ("img-<hash URL>") без
+    // декодирования; уже лежащая в кэше не скачивается.  Только http://.
+    ImageStage diskImageStage(DiskCache& disk);
+
+    bool isPrewarmCommand(const std::vector<std::wstring>& args);
+
+    // Разобрать аргументы (без имени программы), открыть кэш, прогнать
+    // книгу и напечатать прогресс в stderr, итог — в stdout.
+    // makeImage строит ImageStage платформы над открытым кэшем.
+    // 0 — все картинки в кэше, 1 — были сбои, 2 — неверные аргументы.
+    int prewarmMain(const std::vector<std::wstring>& args,
+        const std::function<ImageStage(DiskCache&)>& makeImage);
+
+} // namespace manuscripta
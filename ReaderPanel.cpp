@@ -1,99 +1,255 @@
 ﻿#include "ReaderPanel.h"
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include "config.h"
-#include <unordered_set>
+#include <vector>
 #include "SceneFetcher.h"
 #include "ImageCache.h"
+#include "ImageScaler.h"
 
 const int ReaderPanel::SCROLL_W = GetSystemMetrics(SM_CXVSCROLL);
 
 using std::max;
 using std::min;
 
-bool ReaderPanel::TryMarkFrameRequested(const std::wstring& frame)
+manuscripta::CancelToken ReaderPanel::SceneToken(size_t frameNo)
 {
-    return _requestedFrames.insert(frame).second;
+    return _sceneCancel[frameNo].Token();
 }
 
-std::wstring ReaderPanel::GetFrameText(size_t start, int count) const
+// Отменить запросы всех кадров до frameNo (не включая)
+// и отдать кэшу уже пришедшие для них картинки
+void ReaderPanel::cancelScenesBefore(size_t frameNo)
 {
-    size_t end = findNextParagraph(start, count);
-    if (end > _text.size()) end = _text.size();
-    return _text.substr(start, end - start);
+    auto end = _sceneCancel.lower_bound(frameNo);
+    for (auto it = _sceneCancel.begin(); it != end; ++it)
+        it->second.Cancel();
+    _sceneCancel.erase(_sceneCancel.begin(), end);
+
+    auto readyEnd = _readyScenes.lower_bound(frameNo);
+    for (auto it = _readyScenes.begin(); it != readyEnd; ++it)
+        _imageCache.Release(it->second);
+    _readyScenes.erase(_readyScenes.begin(), readyEnd);
+
+    _sceneRetry.erase(_sceneRetry.begin(), _sceneRetry.lower_bound(frameNo));
 }
 
-size_t ReaderPanel::findNextParagraph(size_t start, int count) const
+// Запросить сцену кадра frameNo.  false — нет места в бюджете
+// одновременных запросов (уже запрошенный кадр места не требует).
+bool ReaderPanel::requestScene(size_t frameNo)
 {
-    size_t pos = start;
-    int found = 0;
-    while (pos < _text.size() && found < count)
-    {
-        if (pos + 1 < _text.size() &&
-            _text[pos] == L'\n' && _text[pos + 1] == L'\n') {
-            ++found;
-            pos += 2;
-        }
-        else if (pos + 3 < _text.size() &&
-            _text[pos] == L'\r' && _text[pos + 1] == L'\n' &&
-            _text[pos + 2] == L'\r' && _text[pos + 3] == L'\n') {
-            ++found;
-            pos += 4;
-        }
-        else {
-            ++pos;
+    // картинка возвращается к номеру кадра — по номеру и помним запрос:
+    // кадр с тем же текстом (например, «* * *») получает свою сцену
+    if (frameNo < _requestedFrames.size() && _requestedFrames[frameNo]) return true;
+    if (FrameBytes(frameNo).empty()) return true;
+    auto retry = _sceneRetry.find(frameNo);
+    if (retry != _sceneRetry.end()) {
+        if (std::chrono::steady_clock::now() < retry->second) return true;   // ещё рано
+        _sceneRetry.erase(retry);
+    }
+    if (!_prefetch->TryStart()) return false;
+    if (_requestedFrames.size() <= frameNo)
+        _requestedFrames.resize(std::max(_paragraphs.FrameCount(), frameNo + 1));
+    _requestedFrames[frameNo] = true;
+
+    // без this: читалку могут закрыть, пока запрос в работе
+    ImageCache* cache = &_imageCache;
+    HWND hwnd = _hParent;
+    manuscripta::CancelToken cancel = SceneToken(frameNo);
+    std::shared_ptr<manuscripta::ScenePrefetcher> prefetch = _prefetch;
+    const auto started = manuscripta::ScenePrefetcher::Clock::now();
+    // картинку грузит fetchScene: не загрузилась по адресу из кэша
+    // сцен — он спросит API заново
+    auto loaded = std::make_shared<HBITMAP>(nullptr);
+
+    fetchSceneAsync(GetFrame(frameNo), [cache, hwnd, cancel, frameNo, prefetch, started, loaded](SceneApiResponse) {
+        HBITMAP bmp = *loaded;
+        prefetch->Finish(started, bmp != nullptr);
+
+        // кадр успел смениться — картинка уже не нужна
+        if (bmp && !cancel.IsCancelled() &&
+            PostMessage(hwnd, WM_USER + 1, reinterpret_cast<WPARAM>(bmp), LPARAM(frameNo)))
+            return;
+        if (bmp) cache->Release(bmp);
+        // место в бюджете освободилось, а OnSceneReady не будет (сеть,
+        // размыкатель, отмена, очередь полна) — WM_USER + 3: кадр снова
+        // можно запросить, окно упреждения дозапрашивает
+        PostMessage(hwnd, WM_USER + 3, 0, LPARAM(frameNo));
+    }, unsigned(frameNo - _frameNo), cancel, [cache, cancel, loaded](const std::wstring& url) {
+        *loaded = cache->Get(url, cancel);
+        return *loaded != nullptr;
+    });
+    return true;
+}
+
+void ReaderPanel::OnSceneFailed(size_t frameNo)
+{
+    if (!IsSceneStale(frameNo) && frameNo < _requestedFrames.size()) {
+        _requestedFrames[frameNo] = false;
+        // не сразу: при разомкнутом размыкателе запрос кончится мгновенно
+        _sceneRetry[frameNo] = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(SCENE_FRAME_RETRY_MS);
+    }
+    PrefetchScenes();
+}
+
+void ReaderPanel::PrefetchScenes()
+{
+    const size_t end = std::min(_paragraphs.FrameCount(), _frameNo + _prefetch->Window());
+    for (size_t n = _frameNo; n < end; ++n)
+        if (!requestScene(n)) break;    // бюджет исчерпан — остальные позже
+}
+
+bool ReaderPanel::OnSceneReady(HBITMAP bmp, size_t frameNo)
+{
+    if (IsSceneStale(frameNo)) {
+        _imageCache.Release(bmp);
+        return false;
+    }
+    if (frameNo == _frameNo) {
+        SetBackground(bmp);
+    }
+    else {
+        // кадр впереди: держим до показа (аренда не даёт вытеснить)
+        auto [it, inserted] = _readyScenes.emplace(frameNo, bmp);
+        if (!inserted) {
+            _imageCache.Release(it->second);
+            it->second = bmp;
         }
     }
-    return pos;
+    PrefetchScenes();                   // место в бюджете освободилось
+    return frameNo == _frameNo;
 }
 
-ReaderPanel::ReaderPanel(HINSTANCE hInst, HWND hParent)
-    : _hInst(hInst), _hParent(hParent)
+void ReaderPanel::showReadyScene()
+{
+    auto it = _readyScenes.find(_frameNo);
+    if (it == _readyScenes.end()) return;
+    SetBackground(it->second);
+    _readyScenes.erase(it);
+}
+
+std::wstring ReaderPanel::GetFrameText(size_t start, int count) const
+{
+    return _text.Substr(start, findNextParagraph(start, count));
+}
+
+size_t ReaderPanel::findNextParagraph(size_t start, int count) const
+{
+    return _paragraphs.NextParagraph(start, count);
+}
+
+size_t ReaderPanel::FrameCount() const
+{
+    return _paragraphs.FrameCount();
+}
+
+std::wstring ReaderPanel::GetFrame(size_t n) const
+{
+    if (n >= _paragraphs.FrameCount()) return {};
+    const manuscripta::FrameSpan& f = _paragraphs.Frame(n);
+    return _text.Substr(f.start, f.end);
+}
+
+std::string_view ReaderPanel::FrameBytes(size_t n) const
+{
+    if (n >= _paragraphs.FrameCount()) return {};
+    const manuscripta::FrameSpan& f = _paragraphs.Frame(n);
+    return _text.Bytes().substr(f.start, f.end - f.start);
+}
+
+void ReaderPanel::loadFrameText()
+{
+    _text.Decode(_frameStart, _endOfFrame, _frameText);
+}
+
+// Georgia 12pt под заданный DPI
+static HFONT createReaderFont(UINT dpi)
 {
     LOGFONTW lf{}; wcscpy_s(lf.lfFaceName, L"Georgia");
     lf.lfCharSet = DEFAULT_CHARSET;
     lf.lfQuality = ANTIALIASED_QUALITY;
+    lf.lfHeight = -MulDiv(12, dpi, 72);
+    return CreateFontIndirectW(&lf);
+}
 
-    HDC hdc = GetDC(nullptr);
-    lf.lfHeight = -MulDiv(12, GetDeviceCaps(hdc, LOGPIXELSY), 72);
-    ReleaseDC(nullptr, hdc);
+ReaderPanel::ReaderPanel(HINSTANCE hInst, HWND hParent, ImageCache& images)
+    : _hInst(hInst), _hParent(hParent), _imageCache(images)
+{
+    _fontDpi = GetDpiForWindow(_hParent);
+    if (!_fontDpi) {
+        HDC hdc = GetDC(nullptr);
+        _fontDpi = GetDeviceCaps(hdc, LOGPIXELSY);
+        ReleaseDC(nullptr, hdc);
+    }
+    _font = createReaderFont(_fontDpi);
 
-    _font = CreateFontIndirectW(&lf);
+    manuscripta::ScenePrefetcher::Config prefetch;
+    prefetch.minWindow = PREFETCH_MIN_FRAMES;
+    prefetch.maxWindow = PREFETCH_MAX_FRAMES;
+    prefetch.maxInFlight = SCENE_WORKERS;
+    _prefetch = std::make_shared<manuscripta::ScenePrefetcher>(prefetch);
 }
 
 ReaderPanel::~ReaderPanel()
 {
+    cancelScenesBefore(SIZE_MAX);           // читалку закрыли — всё устарело
     destroyScrollbar();
+    releaseGdiObjects();
+    _imageCache.SetDisplayed(nullptr);      // картинку можно вытеснять
+    if (_measureDC) DeleteDC(_measureDC);
     DeleteObject(_font);
 }
 
 // ──────────────────────────────────────────────
-//  Возвращает высоту (px) прямоугольника, который
-//  займёт подстрока [_text[start … start+len) ] 
-//  после раскладки DrawTextW с DT_WORDBREAK.
+//  Кэш ширин символов под текущие (_font, DPI окна).
+//  Окно переехало на монитор с другим DPI —
+//  пересоздаём шрифт, кэш и раскладку.
+//  Промахи кэша меряем в собственном memory DC.
 // ──────────────────────────────────────────────
-int ReaderPanel::measureHeightForRange(size_t start, size_t len) const
+void ReaderPanel::ensureGlyphCache()
 {
-    if (len == 0) return 0;
-
-    HDC hdc = GetDC(_hParent);
-    HFONT oldF = (HFONT)SelectObject(hdc, _font);
-
-    RECT rc = _rcBox;
-    rc.right -= SCROLL_W;
-    InflateRect(&rc, -TEXT_MARGIN, -TEXT_MARGIN);
-
-    const wchar_t* slice = _text.c_str() + start;
-    DrawTextW(hdc, slice,
-        static_cast<int>(len), &rc,
-        DT_CALCRECT | DT_WORDBREAK | DT_LEFT | DT_TOP);
-
-    SelectObject(hdc, oldF);
-    ReleaseDC(_hParent, hdc);
+    UINT dpi = GetDpiForWindow(_hParent);
+    if (!dpi) dpi = _fontDpi;
+    if (_glyphs.Matches(reinterpret_cast<uintptr_t>(_font), dpi)) return;
+
+    if (dpi != _fontDpi) {
+        HFONT font = createReaderFont(dpi);
+        if (_measureDC) SelectObject(_measureDC, font);
+        DeleteObject(_font);
+        _font = font;
+        _fontDpi = dpi;
+    }
 
-    return rc.bottom - rc.top; // высота контента
+    if (!_measureDC) _measureDC = CreateCompatibleDC(nullptr);
+    SelectObject(_measureDC, _font);
+
+    TEXTMETRICW tm{};
+    GetTextMetricsW(_measureDC, &tm);
+
+    HDC dc = _measureDC;
+    _glyphs.Reset(reinterpret_cast<uintptr_t>(_font), dpi, tm.tmHeight,
+        [dc](char32_t cp) {
+            wchar_t units[2];
+            int n = 1;
+            if (cp >= 0x10000) {
+                cp -= 0x10000;
+                units[0] = static_cast<wchar_t>(0xD800 + (cp >> 10));
+                units[1] = static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+                n = 2;
+            }
+            else {
+                units[0] = static_cast<wchar_t>(cp);
+            }
+            SIZE sz{};
+            GetTextExtentPoint32W(dc, units, n, &sz);
+            return static_cast<int>(sz.cx);
+        });
+    _layout = {};                    // ширины поменялись — раскладка заново
 }
 
-void ReaderPanel::SetOnFrameChange(std::function<void(const std::wstring&)> cb)
+void ReaderPanel::SetOnFrameChange(std::function<void(std::wstring_view)> cb)
 {
     _onFrameChange = std::move(cb);
 }
@@ -103,20 +259,20 @@ std::wstring ReaderPanel::GetFirstFrame() const
     size_t pos = 0;
 
     // пропускаем пробелы и пустые строки
-    while (pos < _text.size())
+    while (pos < _text.Size())
     {
-        wchar_t ch = _text[pos];
-        if (ch == L'\n' || ch == L'\r' || ch == L' ' || ch == L'\t') ++pos;
+        char ch = _text[pos];
+        if (ch == '\n' || ch == '\r' || ch == ' ' || ch == '\t') ++pos;
         else break;
     }
 
-    size_t end = _text.find(L'\n', pos);
-    if (end == std::wstring::npos)
-        end = _text.size();
+    size_t end = _text.Bytes().find('\n', pos);
+    if (end == std::string_view::npos)
+        end = _text.Size();
     else
         ++end;
 
-    return _text.substr(pos, end - pos);
+    return _text.Substr(pos, end);
 }
 
 //------------------------------------------------------------------
@@ -147,32 +303,35 @@ void ReaderPanel::updateScrollInfo()
 // ─────────────────────────────────────────────────────────────
 size_t ReaderPanel::findParagraphEnd(size_t start) const
 {
-    size_t i = start;
-    while (i + 1 < _text.size()) {
-        // Unix: \n\n
-        if (_text[i] == L'\n' && _text[i + 1] == L'\n')
-            return i;
-
-        // Windows: \r\n\r\n
-        if (i + 3 < _text.size() &&
-            _text[i] == L'\r' &&
-            _text[i + 1] == L'\n' &&
-            _text[i + 2] == L'\r' &&
-            _text[i + 3] == L'\n')
-            return i;
-
-        ++i;
-    }
-    return _text.size(); // не нашли — до конца текста
+    return _paragraphs.ParagraphEnd(start); // не нашли — до конца текста
 }
-void ReaderPanel::SetText(const std::wstring& txt)
+void ReaderPanel::SetText(std::wstring_view txt)
 {
-    _text = txt;
+    manuscripta::TextStore text;
+    text.Append(txt);
+    manuscripta::ParagraphIndex paragraphs;
+    paragraphs.Build(text.Bytes(), SKIP_ENDS);   // разметка один раз на всю книгу
+    SetText(std::move(text), std::move(paragraphs));
+}
+
+void ReaderPanel::SetText(manuscripta::TextStore text, manuscripta::ParagraphIndex paragraphs)
+{
+    _text = std::move(text);
+    _paragraphs = std::move(paragraphs);
+    _loading = false;
+    _layout = {};                          // раскладка прошлой книги больше не годится
+
     _visible = 1;          // оставляем 1 → первый символ сразу виден
     _scrollPos = 0;
     _active = true;
+    cancelScenesBefore(SIZE_MAX);          // запросы прошлой книги
+    _requestedFrames.clear();              // отменены — сцены не придут
+    _sceneRetry.clear();
+    _frameNo = 0;
     _frameStart = 0;
     _cursorPos = 0;
+    _endOfFrame = _paragraphs.FrameCount() ? _paragraphs.Frame(0).end : 0;
+    loadFrameText();
     _frameIdle = false;      // ← лишнее обнуление _visible убрано
 
 
@@ -182,7 +341,26 @@ void ReaderPanel::SetText(const std::wstring& txt)
     recalcTextMetrics();
     ensureScrollbar();
     SetTimer(_hParent, TIMER_ID, TICK_MS, nullptr);
-    InvalidateRect(_hParent, nullptr, FALSE);
+    invalidateAll();
+}
+
+void ReaderPanel::BeginText(size_t expectedBytes)
+{
+    SetText(manuscripta::TextStore(), manuscripta::ParagraphIndex());
+    _text.Reserve(expectedBytes);          // перекодированное — без переездов
+    _loading = true;
+    _visible = 0;                          // первый кадр возьмёт OnTimer из таблицы
+}
+
+void ReaderPanel::AppendText(std::shared_ptr<const manuscripta::MappedFile> file,
+    std::string_view mapped, std::string_view utf8, bool final)
+{
+    if (!_loading) return;
+    if (file) _text.Append(std::move(file), mapped);
+    _text.Append(utf8);
+    _paragraphs.Extend(_text.Bytes(), SKIP_ENDS, final);
+    _loading = !final;
+    if (_active) PrefetchScenes();         // окно упреждения могло упираться в конец таблицы
 }
 
 void ReaderPanel::Resize(const RECT& rcClient)
@@ -191,6 +369,10 @@ void ReaderPanel::Resize(const RECT& rcClient)
     const int cy = rcClient.bottom - BOX_H - 40;
     _rcBox = { cx, cy, cx + BOX_W, cy + BOX_H };
 
+    // новые размеры — back buffer и регион бокса пересоздаст OnPaint
+    releaseBackBuffer();
+    if (_rgnBox) { DeleteObject(_rgnBox); _rgnBox = nullptr; }
+
     recalcTextMetrics();
     positionScrollbar();
     updateScrollInfo();
@@ -202,18 +384,16 @@ void ReaderPanel::drawCloseButton(HDC hdc)
     _rcClose = { cli.right - 48 - 16, 16,
                  cli.right - 16,      16 + 48 };
 
-    HBRUSH brC = CreateSolidBrush(CLR_CLOSE);
-    HGDIOBJ oldBr = SelectObject(hdc, brC);
+    HGDIOBJ oldBr = SelectObject(hdc, _brButton);
     Ellipse(hdc, _rcClose.left, _rcClose.top, _rcClose.right, _rcClose.bottom);
-    SelectObject(hdc, oldBr); DeleteObject(brC);
+    SelectObject(hdc, oldBr);
 
-    HPEN pen = CreatePen(PS_SOLID, 3, RGB(255, 255, 255));
-    HGDIOBJ oldPen = SelectObject(hdc, pen);
+    HGDIOBJ oldPen = SelectObject(hdc, _penGlyph);
     MoveToEx(hdc, _rcClose.left + 12, _rcClose.top + 12, nullptr);
     LineTo(hdc, _rcClose.right - 12, _rcClose.bottom - 12);
     MoveToEx(hdc, _rcClose.right - 12, _rcClose.top + 12, nullptr);
     LineTo(hdc, _rcClose.left + 12, _rcClose.bottom - 12);
-    SelectObject(hdc, oldPen); DeleteObject(pen);
+    SelectObject(hdc, oldPen);
 }
 
 void ReaderPanel::drawPauseButton(HDC hdc)
@@ -222,13 +402,11 @@ void ReaderPanel::drawPauseButton(HDC hdc)
     int py = _rcBox.top + 16;
     _rcPauseBtn = { px, py, px + 40, py + 40 };
 
-    HBRUSH brP = CreateSolidBrush(CLR_CLOSE);
-    HGDIOBJ oldBr = SelectObject(hdc, brP);
+    HGDIOBJ oldBr = SelectObject(hdc, _brButton);
     Ellipse(hdc, _rcPauseBtn.left, _rcPauseBtn.top, _rcPauseBtn.right, _rcPauseBtn.bottom);
-    SelectObject(hdc, oldBr); DeleteObject(brP);
+    SelectObject(hdc, oldBr);
 
-    HPEN pen = CreatePen(PS_SOLID, 3, RGB(255, 255, 255));
-    HGDIOBJ oldPen = SelectObject(hdc, pen);
+    HGDIOBJ oldPen = SelectObject(hdc, _penGlyph);
 
     if (_paused)
     {
@@ -245,18 +423,179 @@ void ReaderPanel::drawPauseButton(HDC hdc)
         Rectangle(hdc, px + 24, py + 10, px + 29, py + 30);
     }
 
-    SelectObject(hdc, oldPen); DeleteObject(pen);
+    SelectObject(hdc, oldPen);
+}
+
+// ──────────────────────────────────────────────
+//  GDI-ресурсы отрисовки.  Кисти / перо живут
+//  всё время жизни панели, регион бокса и back
+//  buffer — до следующего Resize.  Всё, что
+//  создаётся, проходит через trackGdi(), чтобы
+//  OnPaint мог посчитать аллокации за кадр.
+// ──────────────────────────────────────────────
+void ReaderPanel::ensureGdiObjects()
+{
+    if (!_brBox)     _brBox = trackGdi(CreateSolidBrush(CLR_BOX));
+    if (!_brButton)  _brButton = trackGdi(CreateSolidBrush(CLR_CLOSE));
+    if (!_penGlyph)  _penGlyph = trackGdi(CreatePen(PS_SOLID, 3, RGB(255, 255, 255)));
+    if (!_rgnBox)
+        _rgnBox = trackGdi(CreateRoundRectRgn(_rcBox.left, _rcBox.top,
+            _rcBox.right, _rcBox.bottom, BOX_R, BOX_R));
+}
+
+bool ReaderPanel::ensureBackBuffer(HDC hdc, int cx, int cy)
+{
+    if (_backDC && _backSize.cx == cx && _backSize.cy == cy) return false;
+
+    releaseBackBuffer();
+    _backDC = trackGdi(CreateCompatibleDC(hdc));
+    _backBmp = trackGdi(CreateCompatibleBitmap(hdc, cx, cy));
+    _backOld = SelectObject(_backDC, _backBmp);
+    _backSize = { cx, cy };
+    return true;
+}
+
+// ──────────────────────────────────────────────
+//  Иллюстрация, заранее уменьшенная до w×h
+//  (Ланцош-3, ImageScaler) и выбранная в _bgDC.
+//  Пересчитывается только для новой картинки
+//  или нового размера (Resize) — не на каждой
+//  отрисовке, как было с HALFTONE StretchBlt.
+// ──────────────────────────────────────────────
+bool ReaderPanel::ensureScaledBackground(int w, int h)
+{
+    if (_bgScaled && _bgScaledFrom == _bgBitmap &&
+        _bgScaledSize.cx == w && _bgScaledSize.cy == h)
+        return true;
+
+    BITMAP bm{};
+    if (!GetObject(_bgBitmap, sizeof(bm), &bm) || bm.bmWidth <= 0 || bm.bmHeight <= 0)
+        return false;
+
+    // 1. исходник → 32bpp, строки сверху вниз
+    BITMAPINFO bi{};
+    bi.bmiHeader.biSize = sizeof(bi.bmiHeader);
+    bi.bmiHeader.biWidth = bm.bmWidth;
+    bi.bmiHeader.biHeight = -bm.bmHeight;
+    bi.bmiHeader.biPlanes = 1;
+    bi.bmiHeader.biBitCount = 32;
+    bi.bmiHeader.biCompression = BI_RGB;
+
+    std::vector<uint32_t> src(size_t(bm.bmWidth) * bm.bmHeight);
+    if (!GetDIBits(_backDC, _bgBitmap, 0, bm.bmHeight, src.data(), &bi, DIB_RGB_COLORS))
+        return false;
+
+    // 2. целевая DIB-секция того же формата
+    bi.bmiHeader.biWidth = w;
+    bi.bmiHeader.biHeight = -h;
+    void* bits = nullptr;
+    HBITMAP scaled = trackGdi(CreateDIBSection(_backDC, &bi, DIB_RGB_COLORS, &bits, nullptr, 0));
+    if (!scaled) return false;
+
+    manuscripta::resampleLanczos3(
+        { src.data(), bm.bmWidth, bm.bmHeight, size_t(bm.bmWidth) },
+        { static_cast<uint32_t*>(bits), w, h, size_t(w) });
+
+    // 3. меняем кэшированную копию
+    if (!_bgDC) {
+        _bgDC = trackGdi(CreateCompatibleDC(_backDC));
+        _bgOld = SelectObject(_bgDC, scaled);
+    }
+    else {
+        SelectObject(_bgDC, scaled);
+    }
+    if (_bgScaled) DeleteObject(_bgScaled);
+    _bgScaled = scaled;
+    _bgScaledFrom = _bgBitmap;
+    _bgScaledSize = { w, h };
+    return true;
+}
+
+void ReaderPanel::releaseBackBuffer()
+{
+    if (_backDC) {
+        SelectObject(_backDC, _backOld);
+        DeleteDC(_backDC);
+        _backDC = nullptr;
+    }
+    if (_backBmp) { DeleteObject(_backBmp); _backBmp = nullptr; }
+    _backSize = {};
+}
+
+void ReaderPanel::releaseGdiObjects()
+{
+    releaseBackBuffer();
+    if (_bgDC) {
+        SelectObject(_bgDC, _bgOld);
+        DeleteDC(_bgDC);
+        _bgDC = nullptr;
+    }
+    if (_bgScaled) { DeleteObject(_bgScaled); _bgScaled = nullptr; }
+    _bgScaledFrom = nullptr;
+    if (_rgnBox)   { DeleteObject(_rgnBox);   _rgnBox = nullptr; }
+    if (_brBox)    { DeleteObject(_brBox);    _brBox = nullptr; }
+    if (_brButton) { DeleteObject(_brButton); _brButton = nullptr; }
+    if (_penGlyph) { DeleteObject(_penGlyph); _penGlyph = nullptr; }
 }
 
+// ──────────────────────────────────────────────
+//  Что перерисовать:
+//   • _fullRedraw (новый кадр, картинка, скролл,
+//     resize) — вся сцена в back buffer;
+//   • иначе — только полоса _dirtyText, которую
+//     набрал invalidateTyped() (обычно последняя
+//     строка) поверх уже готового фона бокса.
+//  На экран уходит только область обновления.
+// ──────────────────────────────────────────────
 void ReaderPanel::OnPaint(HDC hdc)
 {
     if (!_active) return;
+    const unsigned allocsBefore = _gdiAllocs;
+#ifdef _DEBUG
+    const DWORD handlesBefore = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+#endif
 
-    // ─── double-buffer ─────────────────────────────────────
+    // ─── double-buffer (живёт до Resize) ───────────────────
     RECT cli; GetClientRect(_hParent, &cli);
-    HDC     mem = CreateCompatibleDC(hdc);
-    HBITMAP dib = CreateCompatibleBitmap(hdc, cli.right, cli.bottom);
-    HGDIOBJ oldB = SelectObject(mem, dib);
+    const bool fresh = ensureBackBuffer(hdc, cli.right, cli.bottom);
+    ensureGdiObjects();
+    syncLayout();
+
+    if (_fullRedraw || fresh) {
+        renderScene(cli);
+        _fullRedraw = false;
+    }
+    else if (!IsRectEmpty(&_dirtyText)) {
+        renderTextStrip(_dirtyText);
+    }
+    SetRectEmpty(&_dirtyText);
+    _layout.ClearDirty();
+
+    // ─── вывод на экран — только то, что просили ──────────
+    RECT upd;
+    int kind = GetClipBox(hdc, &upd);
+    if (kind == ERROR) upd = cli;
+    if (kind != NULLREGION)
+        BitBlt(hdc, upd.left, upd.top, upd.right - upd.left, upd.bottom - upd.top,
+            _backDC, upd.left, upd.top, SRCCOPY);
+
+    // ─── учёт GDI-аллокаций: в установившемся режиме — 0 ───
+    _gdiAllocsLastPaint = _gdiAllocs - allocsBefore;
+#ifdef _DEBUG
+    const DWORD handlesAfter = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+    if (handlesAfter != handlesBefore || _gdiAllocsLastPaint) {
+        wchar_t msg[96];
+        swprintf_s(msg, L"ReaderPanel::OnPaint: %u GDI allocs, handles %lu -> %lu\n",
+            _gdiAllocsLastPaint, handlesBefore, handlesAfter);
+        OutputDebugStringW(msg);
+    }
+#endif
+}
+
+// Полная сцена в back buffer: фон, иллюстрация, бокс, текст, кнопки
+void ReaderPanel::renderScene(const RECT& cli)
+{
+    HDC mem = _backDC;
 
     // ─── фон окна (чёрный) ─────────────────────────────────
     FillRect(mem, &cli, (HBRUSH)GetStockObject(BLACK_BRUSH));
@@ -268,9 +607,6 @@ void ReaderPanel::OnPaint(HDC hdc)
         const int topMargin = 40;   // отступ от верхнего края окна
         const int gap = 8;    // микро-зазор до _rcBox
 
-        HDC hTmp = CreateCompatibleDC(mem);
-        HGDIOBJ o = SelectObject(hTmp, _bgBitmap);
-
         BITMAP bm; GetObject(_bgBitmap, sizeof(bm), &bm);
 
         // 1. свободная «рамка» для картинки
@@ -288,58 +624,111 @@ void ReaderPanel::OnPaint(HDC hdc)
         int x = (cli.right - w) / 2;
         int y = topMargin;
 
-        SetStretchBltMode(mem, HALFTONE);            // сглаживаем
-        StretchBlt(mem, x, y, w, h,
-            hTmp, 0, 0, bm.bmWidth, bm.bmHeight, SRCCOPY);
-
-        SelectObject(hTmp, o);
-        DeleteDC(hTmp);
+        // 4. готовая уменьшенная копия — без пересэмплинга на каждом кадре
+        if (w > 0 && h > 0 && ensureScaledBackground(w, h))
+            BitBlt(mem, x, y, w, h, _bgDC, 0, 0, SRCCOPY);
     }
 
 
     // ─── серый текстовый бокс ──────────────────────────────
-    HRGN rgn = CreateRoundRectRgn(_rcBox.left, _rcBox.top,
-        _rcBox.right, _rcBox.bottom,
-        BOX_R, BOX_R);
-    HBRUSH br = CreateSolidBrush(CLR_BOX);
-    FillRgn(mem, rgn, br);
-    DeleteObject(br);
-    DeleteObject(rgn);
+    FillRgn(mem, _rgnBox, _brBox);
 
     // ─── текст внутри бокса ────────────────────────────────
+    drawTextLines(mem, textClipRect());
+
+    // ─── кнопки (⨉ и ▶▮▮) ─────────────────────────────────
+    drawCloseButton(mem);
+    drawPauseButton(mem);
+}
+
+// Полоса текста: фон бокса + строки (+ кнопка паузы, если задета)
+void ReaderPanel::renderTextStrip(const RECT& strip)
+{
+    HDC mem = _backDC;
+    FillRect(mem, &strip, _brBox);
+    drawTextLines(mem, strip);
+
+    RECT hit;
+    if (IntersectRect(&hit, &strip, &_rcPauseBtn)) {
+        SaveDC(mem);
+        IntersectClipRect(mem, strip.left, strip.top, strip.right, strip.bottom);
+        drawPauseButton(mem);
+        RestoreDC(mem, -1);
+    }
+}
+
+// Строки _layout, попадающие в clip (∩ окно текста)
+void ReaderPanel::drawTextLines(HDC mem, const RECT& clip)
+{
+    RECT rc;
+    const RECT box = textClipRect();
+    if (!IntersectRect(&rc, &clip, &box) || !_layout.Laid()) return;
+
     RECT rcT = _rcBox;
     rcT.right -= SCROLL_W;
     InflateRect(&rcT, -TEXT_MARGIN, -TEXT_MARGIN);
     rcT.top -= _scrollPos;
 
+    SaveDC(mem);                     // шрифт вернётся вместе с клипом
     SelectObject(mem, _font);
     SetTextColor(mem, CLR_TEXT);
     SetBkMode(mem, TRANSPARENT);
+    IntersectClipRect(mem, rc.left, rc.top, rc.right, rc.bottom);
 
-    SaveDC(mem);
-    IntersectClipRect(mem,
-        _rcBox.left + TEXT_MARGIN,
-        _rcBox.top + TEXT_MARGIN,
-        _rcBox.right - TEXT_MARGIN,
-        _rcBox.bottom - TEXT_MARGIN);
-
-    const wchar_t* slice = _text.c_str() + _frameStart;
-    int visible = static_cast<int>(_visible);
+    const wchar_t* slice = _frameText.c_str();
+    const int lineH = max(1, _layout.LineHeight());
+    size_t i = rc.top > rcT.top ? static_cast<size_t>((rc.top - rcT.top) / lineH) : 0;
+    for (; i < _layout.LineCount(); ++i)
+    {
+        const int y = rcT.top + static_cast<int>(i) * lineH;
+        if (y >= rc.bottom) break;
 
-    DrawTextW(mem, slice, visible, &rcT,
-        DT_WORDBREAK | DT_LEFT | DT_TOP);
+        const manuscripta::LayoutLine& ln = _layout.Line(i);
+        size_t end = ln.end;
+        while (end > ln.start && slice[end - 1] == L'\r') --end;
+        TextOutW(mem, rcT.left, y, slice + ln.start, static_cast<int>(end - ln.start));
+    }
 
     RestoreDC(mem, -1);
+}
 
-    // ─── кнопки (⨉ и ▶▮▮) ─────────────────────────────────
-    drawCloseButton(mem);
-    drawPauseButton(mem);
+RECT ReaderPanel::textClipRect() const
+{
+    return { _rcBox.left + TEXT_MARGIN, _rcBox.top + TEXT_MARGIN,
+             _rcBox.right - TEXT_MARGIN, _rcBox.bottom - TEXT_MARGIN };
+}
 
-    // ─── вывод на экран ────────────────────────────────────
-    BitBlt(hdc, 0, 0, cli.right, cli.bottom, mem, 0, 0, SRCCOPY);
-    SelectObject(mem, oldB);
-    DeleteObject(dib);
-    DeleteDC(mem);
+// ──────────────────────────────────────────────
+//  Инвалидация.  invalidateTyped — только строки,
+//  изменённые с прошлой отрисовки; остальное —
+//  полная перерисовка back buffer.
+// ──────────────────────────────────────────────
+void ReaderPanel::invalidateTyped()
+{
+    const size_t first = _layout.FirstDirtyLine();
+    if (first == manuscripta::TextLayout::npos) return;
+
+    const RECT clip = textClipRect();
+    const int lineH = _layout.LineHeight();
+    const int top = clip.top - _scrollPos;
+    RECT strip{ clip.left, top + static_cast<int>(first) * lineH,
+                clip.right, top + static_cast<int>(_layout.LineCount()) * lineH };
+    if (!IntersectRect(&strip, &strip, &clip)) return;
+
+    UnionRect(&_dirtyText, &_dirtyText, &strip);
+    InvalidateRect(_hParent, &strip, FALSE);
+}
+
+void ReaderPanel::invalidateBox()
+{
+    _fullRedraw = true;
+    InvalidateRect(_hParent, &_rcBox, FALSE);
+}
+
+void ReaderPanel::invalidateAll()
+{
+    _fullRedraw = true;
+    InvalidateRect(_hParent, nullptr, FALSE);
 }
 
 void ReaderPanel::positionScrollbar()
@@ -377,58 +766,41 @@ void ReaderPanel::ensureScrollbar()
 
 void ReaderPanel::OnTimer()
 {
+    if (_active && !_sceneRetry.empty()) PrefetchScenes();   // срок повтора мог подойти
     if (!_active || _paused) return;
 
-    // ---------- конец книги? ----------
-    if (_frameStart + _visible >= _text.size()) {
-        KillTimer(_hParent, TIMER_ID);
+    // ---------- конец книги? (или прочитанного на сейчас) ----------
+    const bool typedToEnd = _visible == 0 ? _frameStart >= _text.Size()
+        : _endOfFrame >= _text.Size() && _visible >= _frameText.size();
+    if (typedToEnd) {
+        if (!_loading) KillTimer(_hParent, TIMER_ID);
         return;
     }
 
     // ---------- начало НОВОГО кадра ----------
     if (_visible == 0) {
         //_bgBitmap = nullptr;           // ✨ убираем прошлую иллюстрацию
-        InvalidateRect(_hParent, nullptr, FALSE);
-        // ───── старт и конец кадра ─────
-        size_t start = _frameStart;
-        size_t end = findNextParagraph(start, SKIP_ENDS);
-        if (end > _text.size()) end = _text.size();
+        // ───── старт и конец кадра — из таблицы ─────
+        if (_frameNo >= _paragraphs.FrameCount()) {
+            if (!_loading) KillTimer(_hParent, TIMER_ID);   // иначе ждём блок
+            return;
+        }
+        invalidateAll();
+        const manuscripta::FrameSpan& frame = _paragraphs.Frame(_frameNo);
 
         // ───── обновляем текущий кадр ─────
-        _frameStart = start;
-        _endOfFrame = end;
-
-        if (_onFrameChange) {
-            std::wstring frameText = _text.substr(_frameStart, _endOfFrame - _frameStart);
-            _onFrameChange(frameText);
-            // ─── [NEW] Кэшируем и запрашиваем 2 сцены ───────────────
-            auto sendSceneRequest = [this](const std::wstring& chunk) {
-                if (_requestedFrames.insert(chunk).second) {
-                    fetchSceneAsync(chunk, [this](SceneApiResponse scene) {
-                        if (scene.imageUrl.empty())
-                            return;
+        _frameStart = frame.start;
+        _endOfFrame = frame.end;
+        loadFrameText();                   // в UTF-16 — только этот кадр
+
+        if (_onFrameChange)
+            _onFrameChange(_frameText);
 
-                        if (HBITMAP bmp = _imageCache.Get(scene.imageUrl))
-                        {
-                            PostMessage(_hParent, WM_USER + 1, reinterpret_cast<WPARAM>(bmp), 0);
-                        }
-                    });
-                }
-            };
-
-            // отправка текущей сцены
-            sendSceneRequest(frameText);
-
-            // попытка запроса следующей сцены (на +SKIP_ENDS)
-            size_t nextStart = findNextParagraph(_endOfFrame, 0);
-            size_t nextEnd = findNextParagraph(nextStart, SKIP_ENDS);
-            if (nextEnd > _text.size()) nextEnd = _text.size();
-
-            if (nextStart < nextEnd) {
-                std::wstring nextFrame = _text.substr(nextStart, nextEnd - nextStart);
-                sendSceneRequest(nextFrame);
-            }
-        }
+        // ───── иллюстрация: пришедшая заранее — сразу на экран,
+        //       запросы — на окно кадров вперёд ─────
+        _prefetch->FrameShown();
+        showReadyScene();
+        PrefetchScenes();
 
         // ───── ничего не печатаем, если пусто ─────
         if (_frameStart == _endOfFrame) {
@@ -443,11 +815,11 @@ void ReaderPanel::OnTimer()
     // ─── Обработка мгновенного пропуска по клику ───
     if (_pendingSkip) {
         _pendingSkip = false;
-        _visible = static_cast<int>(_endOfFrame - _frameStart - 1);
+        _visible = _frameText.size() - 1;
 
         recalcTextMetrics();
         ensureScrollbar();
-        InvalidateRect(_hParent, &_rcBox, FALSE);
+        invalidateTyped();
         return;
     }
     // ---------- печатаем символ ----------
@@ -455,20 +827,19 @@ void ReaderPanel::OnTimer()
 
 
     // ---------- кадр напечатан? ----------
-    if (_frameStart + _visible >= _endOfFrame) {
+    if (_visible >= _frameText.size()) {
         _paused = true;                // ставим авто-паузу
         _frameIdle = true;
-        _cursorPos = _endOfFrame;         // откуда продолжать
-
-        // пропускаем пробелы / табы, но не \n
-        while (_cursorPos < _text.size() &&
-            (_text[_cursorPos] == L' ' || _text[_cursorPos] == L'\t'))
-            ++_cursorPos;
+        // откуда продолжать: начало следующего кадра (пробелы / табы
+        // после разрыва уже пропущены при построении таблицы)
+        _cursorPos = (_frameNo + 1 < _paragraphs.FrameCount())
+            ? _paragraphs.Frame(_frameNo + 1).start
+            : _text.Size();
     }
     // ---------- перерисовка ----------
     recalcTextMetrics();
     ensureScrollbar();
-    InvalidateRect(_hParent, &_rcBox, FALSE);
+    invalidateTyped();
 }
 
 bool ReaderPanel::OnClick(int x, int y)
@@ -478,11 +849,13 @@ bool ReaderPanel::OnClick(int x, int y)
     if (PtInRect(&_rcPauseBtn, { x, y }))
     {
         _paused = !_paused;
-        InvalidateRect(_hParent, &_rcBox, FALSE);
+        invalidateBox();
         return true;
     }
     if (PtInRect(&_rcBox, { x, y })) {
         if (_paused && _frameIdle) {
+            ++_frameNo;
+            cancelScenesBefore(_frameNo);     // прошлый кадр больше не нужен
             _frameStart = _cursorPos;
             _visible = 0;
             _scrollPos = 0;
@@ -490,7 +863,7 @@ bool ReaderPanel::OnClick(int x, int y)
             _frameIdle = false;
             recalcTextMetrics();
             ensureScrollbar();
-            InvalidateRect(_hParent, &_rcBox, FALSE);
+            invalidateBox();
         }
         else {
             _pendingSkip = true;
@@ -516,7 +889,7 @@ bool ReaderPanel::OnMouseWheel(short delta)
     _autoScroll = false;                             // пользователь крутил вручную
 
     updateScrollInfo();
-    InvalidateRect(_hParent, nullptr, FALSE);
+    invalidateBox();
     return true;                                      // событие обработано
 }
 
@@ -546,7 +919,7 @@ bool ReaderPanel::OnVScroll(HWND hScrollWnd, WPARAM wParam)
     _autoScroll = false;
 
     updateScrollInfo();
-    InvalidateRect(_hParent, nullptr, FALSE);
+    invalidateBox();
     return true;                                  // событие обработано
 }
 
@@ -554,34 +927,52 @@ bool ReaderPanel::OnVScroll(HWND hScrollWnd, WPARAM wParam)
 //             helpers
 // ──────────────────────────────────────────────
 void ReaderPanel::recalcTextMetrics() {
-    if (_text.empty() || _visible == 0)
+    if (_text.Empty() || _visible == 0)
         return;
 
-    HDC hdc = GetDC(_hParent);
-    HFONT oldFont = (HFONT)SelectObject(hdc, _font);  // ← правильно
+    syncLayout();                    // досчитываем только новые символы
 
-    RECT rc = _rcBox;
-    rc.right -= SCROLL_W;
-    InflateRect(&rc, -TEXT_MARGIN, -TEXT_MARGIN);
-
-    const wchar_t* slice = _text.c_str() + _frameStart;
-    int len = static_cast<int>(_visible);
-
-    DrawTextW(hdc, slice, len, &rc,
-        DT_CALCRECT | DT_WORDBREAK | DT_LEFT | DT_TOP);
-
-    int contentHeight = rc.bottom - rc.top;
+    int contentHeight = _layout.Height();
     _maxScroll = max(0, contentHeight - (_rcBox.bottom - _rcBox.top));
     _textHeight = contentHeight;
 
-    if (_scrollPos > _maxScroll)
+    if (_scrollPos > _maxScroll) {
         _scrollPos = _maxScroll;
-
-    SelectObject(hdc, oldFont);     // ← возвращаем обратно
-    ReleaseDC(_hParent, hdc);
+        _fullRedraw = true;          // текст сдвинулся целиком
+    }
 }
 
+// ──────────────────────────────────────────────
+//  Довести _layout до _visible символов кадра.
+//  Новый кадр / другая ширина / откат назад —
+//  раскладка с нуля, иначе дописываем хвост.
+//  Ширины берутся из _glyphs — HDC не нужен.
+// ──────────────────────────────────────────────
+void ReaderPanel::syncLayout()
+{
+    ensureGlyphCache();
 
+    RECT rc = _rcBox;
+    rc.right -= SCROLL_W;
+    InflateRect(&rc, -TEXT_MARGIN, -TEXT_MARGIN);
+    const int width = rc.right - rc.left;
+
+    // _frameText — кадр _frameStart, пока OnTimer не взял следующий
+    size_t count = _visible;
+    if (_frameStart >= _text.Size()) count = 0;
+    else count = min(count, _frameText.size());
+
+    if (_layoutFrame != _frameStart || _layout.MaxWidth() != width ||
+        _layout.LineCount() == 0 || count < _layout.Laid())
+    {
+        _layout.Reset(width, _glyphs.LineHeight());
+        _layoutFrame = _frameStart;
+    }
+    if (count == _layout.Laid()) return;
+
+    _layout.Extend(_frameText.c_str(), count,
+        [this](char32_t cp) { return _glyphs.Advance(cp); });
+}
 
 void ReaderPanel::destroyScrollbar()
 {
@@ -593,5 +984,7 @@ void ReaderPanel::SetBackground(HBITMAP bmp)
 {
     //if (!bmp) return;                        // 🔹 ничего — выходим
     _bgBitmap = bmp;
-    InvalidateRect(_hParent, nullptr, FALSE);
+    _imageCache.SetDisplayed(bmp);   // не вытеснять, пока на экране
+    _bgScaledFrom = nullptr;     // хэндл мог быть переиспользован — масштабируем заново
+    invalidateAll();
 }
\ No newline at end of file
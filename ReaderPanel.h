@@ -1,9 +1,19 @@
 ﻿#pragma once
 #include <windows.h>
 #include <string>
+#include <string_view>
 #include <functional>
-#include <unordered_set>
+#include <map>
+#include <vector>
+#include <chrono>
 #include "ImageCache.h"
+#include "ParagraphIndex.h"
+#include "TextStore.h"
+#include "TextLayout.h"
+#include "GlyphCache.h"
+#include "CancelToken.h"
+#include "ScenePrefetcher.h"
+#include <memory>
 
 // ────────────────────────────────────────────────────────────────
 //  Вертикальная читалка с собственным скроллбаром и «эффектом
@@ -13,11 +23,25 @@
 class ReaderPanel
 {
 public:
-    explicit ReaderPanel(HINSTANCE hInst, HWND hParent);
+    ReaderPanel(HINSTANCE hInst, HWND hParent, ImageCache& images);
     ~ReaderPanel();
 
-    // Загрузить текст и стартовать анимацию «печати»
-    void SetText(const std::wstring& txt);
+    // Загрузить текст и стартовать анимацию «печати».  Книга хранится
+    // в UTF-8 (TextStore); все позиции ниже — байты в ней.
+    void SetText(std::wstring_view txt);
+    // То же для уже размеченного текста (paragraphs — по байтам text)
+    void SetText(manuscripta::TextStore text, manuscripta::ParagraphIndex paragraphs);
+
+    // Потоковая загрузка: BeginText — пустая книга (expectedBytes —
+    // примерный размер в UTF-8, если текст придётся копить), AppendText —
+    // очередной блок: mapped — UTF-8 прямо из отображения file (читалка
+    // держит его и не копирует), utf8 — перекодированное продолжение.
+    // Печать начинается, как только полон первый кадр; дойдя до ещё не
+    // прочитанного, читалка ждёт следующего блока.
+    void BeginText(size_t expectedBytes);
+    void AppendText(std::shared_ptr<const manuscripta::MappedFile> file,
+        std::string_view mapped, std::string_view utf8, bool final);
+    bool IsLoading() const { return _loading; }
 
     // ───── вызовы из родителя ─────
     void Resize(const RECT& rcClient);
@@ -31,41 +55,90 @@ public:
     void updateScrollInfo();
     std::wstring GetFirstFrame() const;
     void SetBackground(HBITMAP bmp);
-    void SetOnFrameChange(std::function<void(const std::wstring&)> cb);
+    // cb получает кадр на экране — view буфера читалки, живёт до смены кадра
+    void SetOnFrameChange(std::function<void(std::wstring_view)> cb);
 
     std::wstring GetFrameText(size_t start, int count) const;
     size_t findNextParagraph(size_t start, int count) const;
     size_t findParagraphEnd(size_t start) const;
 
-    bool TryMarkFrameRequested(const std::wstring& frame);
+    // Таблица кадров (строится в SetText): число кадров и текст кадра n.
+    // GetFrame — своя строка (её можно отдать в fetchSceneAsync через
+    // std::move), FrameBytes — UTF-8 без копии, до следующего AppendText
+    size_t FrameCount() const;
+    std::wstring GetFrame(size_t n) const;
+    std::string_view FrameBytes(size_t n) const;
+
+    // Запросы сцен привязаны к номеру кадра: читатель ушёл с кадра —
+    // его запросы отменяются, а картинки не доходят до экрана
+    manuscripta::CancelToken SceneToken(size_t frameNo);
+    bool   IsSceneStale(size_t frameNo) const { return frameNo < _frameNo; }
+    size_t CurrentFrame() const { return _frameNo; }
+
+    // Держать запрошенными кадры [текущий, текущий + окно) — окно
+    // подстраивает ScenePrefetcher
+    void PrefetchScenes();
+    // Запрос сцены кадра frameNo кончился без картинки (WM_USER + 3):
+    // место в бюджете свободно, сам кадр — повторить через
+    // SCENE_FRAME_RETRY_MS
+    void OnSceneFailed(size_t frameNo);
+    // Картинка кадра frameNo пришла (WM_USER + 1).  Кадр впереди —
+    // откладывается до его показа.  true — показана сейчас.
+    bool OnSceneReady(HBITMAP bmp, size_t frameNo);
+
+    // Сколько GDI-объектов создал последний OnPaint (в норме — 0)
+    unsigned GdiAllocsLastPaint() const { return _gdiAllocsLastPaint; }
+    unsigned GdiAllocsTotal() const { return _gdiAllocs; }
 private:
     // ─── scrolling state ─────────────────────────────
     int  _textHeight{ 0 };     // полная высота разметки
     bool _autoScroll{ true };  // true, пока пользователь не трогал колёсико
 
     void positionScrollbar();   // поставить ползунок в правый край _rcBox
-    std::function<void(const std::wstring&)> _onFrameChange;
+    std::function<void(std::wstring_view)> _onFrameChange;
     void drawCloseButton(HDC hdc);
     void drawPauseButton(HDC hdc);
+    void ensureGdiObjects();             // кисти / перо / регион бокса
+    bool ensureBackBuffer(HDC hdc, int cx, int cy);   // true → пересоздан
+    void renderScene(const RECT& cli);
+    void renderTextStrip(const RECT& strip);
+    void drawTextLines(HDC mem, const RECT& clip);
+    RECT textClipRect() const;
+    void invalidateTyped();              // только изменившиеся строки
+    void invalidateBox();
+    void invalidateAll();
+    void releaseBackBuffer();
+    bool ensureScaledBackground(int w, int h);
+    void releaseGdiObjects();
+    template <class T> T trackGdi(T h) { if (h) ++_gdiAllocs; return h; }
     void recalcTextMetrics();            // пересчитать высоту текста + _maxScroll
+    void syncLayout();                   // догнать _layout до _visible
+    void ensureGlyphCache();             // кэш ширин под (_font, DPI окна)
     void ensureScrollbar();              // создать/обновить _hScroll
     void destroyScrollbar();             // убрать при закрытии
-    int measureHeightForRange(size_t start, size_t len) const;
 
     // ───── данные ─────
     HINSTANCE   _hInst{};
     HWND        _hParent{};
     HWND        _hScroll{};
     HFONT       _font{};
+    UINT        _fontDpi = 96;          // DPI, под который создан _font
+    HDC         _measureDC{};           // memory DC для промахов _glyphs
+    manuscripta::GlyphAdvanceCache _glyphs;
 
-    std::wstring _text;
-    size_t      _visible = 0;          // сколько символов уже «проявилось»
+    manuscripta::TextStore _text;      // книга в UTF-8
+    manuscripta::ParagraphIndex _paragraphs;   // абзацы / кадры _text (в байтах)
+    std::wstring _frameText;           // текущий кадр в UTF-16 — раскладка и GDI
+    size_t      _visible = 0;          // сколько единиц _frameText уже «проявилось»
+    manuscripta::TextLayout _layout;   // строки текущего кадра
+    size_t      _layoutFrame = 0;      // _frameStart, для которого разложен _layout
     int         _scrollPos = 0;          // текущий отступ вверх, px
     int         _maxScroll = 0;          // максимум прокрутки, px
 
     RECT        _rcBox{};               // серый прямоугольник
     RECT        _rcClose{};             // круг-крестик
     bool        _active = false;
+    bool        _loading = false;       // книга ещё дочитывается (AppendText)
 
     // ───── константы ─────
     static constexpr UINT TIMER_ID = 1;
@@ -84,13 +157,42 @@ private:
     bool _paused = false;
     RECT _rcPauseBtn{};
     // ───── новые переменные для кадрирования ─────
-    size_t  _frameStart = 0;   // индекс первого символа текущего кадра
+    size_t  _frameNo = 0;      // номер текущего кадра в _paragraphs
+    size_t  _frameStart = 0;   // первый байт текущего кадра в _text
     size_t  _cursorPos = 0;   // куда продолжать после паузы
     bool _frameIdle = false;
-    size_t _endOfFrame = 0; // конец текущего кадра (не включая)
+    size_t _endOfFrame = 0; // конец текущего кадра (не включая), байт
+    void loadFrameText();      // _frameText ← _text[_frameStart, _endOfFrame)
 
-    std::unordered_set<std::wstring> _requestedFrames;
+    // запрошенные кадры — бит на номер кадра
+    std::vector<bool> _requestedFrames;
+    std::map<size_t, std::chrono::steady_clock::time_point> _sceneRetry;   // кадр → не раньше
+    std::map<size_t, manuscripta::CancelSource> _sceneCancel;   // кадр → отмена
+    std::map<size_t, HBITMAP> _readyScenes;     // пришли раньше своего кадра
+    std::shared_ptr<manuscripta::ScenePrefetcher> _prefetch;
+    void cancelScenesBefore(size_t frameNo);
+    bool requestScene(size_t frameNo);
+    void showReadyScene();
 
     HBITMAP _bgBitmap = nullptr;
-    ImageCache _imageCache;
+
+    // ───── GDI-объекты отрисовки (создаются один раз) ─────
+    HDC      _backDC{};                 // постоянный back buffer
+    HBITMAP  _backBmp{};
+    HGDIOBJ  _backOld{};
+    SIZE     _backSize{};
+    HDC      _bgDC{};                   // DC с уменьшенной иллюстрацией
+    HGDIOBJ  _bgOld{};
+    HBITMAP  _bgScaled{};               // _bgBitmap под размер окна
+    HBITMAP  _bgScaledFrom{};           // из какой картинки посчитан _bgScaled
+    SIZE     _bgScaledSize{};
+    HBRUSH   _brBox{};
+    HBRUSH   _brButton{};
+    HPEN     _penGlyph{};
+    HRGN     _rgnBox{};
+    bool     _fullRedraw = true;        // back buffer устарел целиком
+    RECT     _dirtyText{};              // полоса строк для частичной отрисовки
+    unsigned _gdiAllocs = 0;            // всего создано GDI-объектов
+    unsigned _gdiAllocsLastPaint = 0;   // из них — последним OnPaint
+    ImageCache& _imageCache;            // владелец — MenuWindow
 };
@@ -1,69 +1,275 @@
 ﻿#include "SceneFetcher.h"
-#include <windows.h>
-#include <winhttp.h>
+#include "CircuitBreaker.h"
+#include "HttpClient.h"
+#include "Utf8.h"
 #include "nlohmann_json.hpp"
-#include "thread"
+#include "WorkerPool.h"
 #include "config.h"
+#include "DiskCache.h"
+#include "Hash.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cwchar>
+#include <memory>
+#include <mutex>
+#include <random>
 
-#pragma comment(lib, "winhttp.lib")
 
 using json = nlohmann::json;
 
+static std::atomic<manuscripta::DiskCache*> g_sceneCache{ nullptr };
+
+void setSceneCache(manuscripta::DiskCache* cache)
+{
+    g_sceneCache = cache;
+}
+
+// Сервер сцен и его предохранитель.  Список заменяется целиком;
+// запрос держит свою копию, так что замена его не задевает.
+struct EndpointSlot {
+    SceneEndpoint endpoint;
+    std::shared_ptr<manuscripta::CircuitBreaker> breaker;
+};
+
+static std::mutex g_endpointMutex;
+static std::vector<EndpointSlot> g_endpoints;
+static bool g_endpointsSet = false;
+
+static std::atomic<uint64_t> g_requests{ 0 }, g_attempts{ 0 }, g_retries{ 0 },
+    g_succeeded{ 0 }, g_failed{ 0 }, g_shortCircuited{ 0 }, g_breakerTrips{ 0 };
+
+static std::vector<EndpointSlot> makeSlots(std::vector<SceneEndpoint> list)
+{
+    if (list.empty()) list.push_back(SceneEndpoint{});
+
+    manuscripta::CircuitBreaker::Config cfg;
+    cfg.failureThreshold = SCENE_BREAKER_FAILURES;
+    cfg.cooldown = std::chrono::milliseconds(SCENE_BREAKER_COOLDOWN_MS);
+    cfg.maxCooldown = cfg.cooldown * 8;
+
+    std::vector<EndpointSlot> slots;
+    for (const SceneEndpoint& ep : list)
+        slots.push_back({ ep, std::make_shared<manuscripta::CircuitBreaker>(cfg) });
+    return slots;
+}
+
+// MANUSCRIPTA_SCENE_SERVERS="host[:port][/path],..."
+static std::vector<SceneEndpoint> endpointsFromEnvironment()
+{
+    std::wstring value;
+#ifdef _WIN32
+    wchar_t* env = nullptr;
+    size_t len = 0;
+    if (_wdupenv_s(&env, &len, L"MANUSCRIPTA_SCENE_SERVERS") == 0 && env) {
+        value = env;
+        std::free(env);
+    }
+#else
+    if (const char* env = std::getenv("MANUSCRIPTA_SCENE_SERVERS"))
+        if (!manuscripta::utf8ToWide(env, value)) value.clear();
+#endif
+
+    std::vector<SceneEndpoint> list;
+    size_t pos = 0;
+    while (pos < value.size())
+    {
+        size_t end = value.find_first_of(L",; \t", pos);
+        if (end == std::wstring::npos) end = value.size();
+        SceneEndpoint ep;
+        if (end > pos && parseSceneEndpoint(value.substr(pos, end - pos), ep))
+            list.push_back(ep);
+        pos = end + 1;
+    }
+    return list;
+}
+
+static std::vector<EndpointSlot> endpointSlots()
+{
+    std::lock_guard<std::mutex> lock(g_endpointMutex);
+    if (!g_endpointsSet) {
+        g_endpoints = makeSlots(endpointsFromEnvironment());
+        g_endpointsSet = true;
+    }
+    return g_endpoints;
+}
+
+void setSceneEndpoints(const std::vector<SceneEndpoint>& endpoints)
+{
+    std::vector<EndpointSlot> slots = makeSlots(endpoints);
+    std::lock_guard<std::mutex> lock(g_endpointMutex);
+    g_endpoints = std::move(slots);
+    g_endpointsSet = true;
+}
+
+void setSceneEndpoint(const SceneEndpoint& endpoint)
+{
+    setSceneEndpoints({ endpoint });
+}
+
+std::vector<SceneEndpoint> sceneEndpoints()
+{
+    std::vector<SceneEndpoint> list;
+    for (const EndpointSlot& slot : endpointSlots())
+        list.push_back(slot.endpoint);
+    return list;
+}
+
+SceneEndpoint sceneEndpoint()
+{
+    return endpointSlots().front().endpoint;
+}
+
+SceneFetchStats sceneFetchStats()
+{
+    SceneFetchStats s;
+    s.requests = g_requests;
+    s.attempts = g_attempts;
+    s.retries = g_retries;
+    s.succeeded = g_succeeded;
+    s.failed = g_failed;
+    s.shortCircuited = g_shortCircuited;
+    s.breakerTrips = g_breakerTrips;
+    return s;
+}
+
+bool parseSceneEndpoint(std::wstring s, SceneEndpoint& endpoint)
+{
+    static const std::wstring scheme = L"http://";
+    if (s.compare(0, scheme.size(), scheme) == 0) s.erase(0, scheme.size());
+
+    SceneEndpoint ep = endpoint;
+    const size_t slash = s.find(L'/');
+    if (slash != std::wstring::npos) {
+        ep.path = s.substr(slash);
+        s.resize(slash);
+    }
+    const size_t colon = s.rfind(L':');
+    if (colon != std::wstring::npos) {
+        const unsigned long port = std::wcstoul(s.c_str() + colon + 1, nullptr, 10);
+        if (port == 0 || port > 65535) return false;
+        ep.port = uint16_t(port);
+        s.resize(colon);
+    }
+    if (s.empty()) return false;
+    ep.host = s;
+    endpoint = ep;
+    return true;
+}
+
 static std::string to_utf8(const std::wstring& wstr)
 {
-    if (wstr.empty()) return {};
-    int size_needed = WideCharToMultiByte(CP_UTF8, 0, wstr.data(), (int)wstr.size(), nullptr, 0, nullptr, nullptr);
-    std::string strTo(size_needed, 0);
-    WideCharToMultiByte(CP_UTF8, 0, wstr.data(), (int)wstr.size(), strTo.data(), size_needed, nullptr, nullptr);
-    return strTo;
+    return manuscripta::wideToUtf8(wstr);
 }
 
-//  UTF-8  → UTF-16 (std::wstring)
+//  UTF-8  → wstring (UTF-16 на Windows, UTF-32 на Linux)
 //  --------------------------------
 static std::wstring utf8_to_wstr(const std::string& utf8)
 {
-    if (utf8.empty()) return {};                     // пустая строка → пустой wstring
+    std::wstring wstr;
+    if (!manuscripta::utf8ToWide(utf8, wstr))       // отсекаем невалидные последовательности
+        return {};
+    return wstr;
+}
 
-    int lenW = MultiByteToWideChar(
-        CP_UTF8,                // исходная кодировка
-        MB_ERR_INVALID_CHARS,   // отсекаем невалидные последовательности
-        utf8.data(),
-        static_cast<int>(utf8.size()),
-        nullptr, 0);
 
-    if (lenW <= 0) return {};                        // конвертация провалилась
+static SceneApiResponse fetchSceneRemote(const std::wstring& text,
+    const manuscripta::CancelToken& cancel);
 
-    std::wstring wstr(lenW, L'\0');
-    MultiByteToWideChar(CP_UTF8, 0,
-        utf8.data(), static_cast<int>(utf8.size()),
-        wstr.data(), lenW);
+SceneApiResponse fetchScene(const std::wstring& text, const manuscripta::CancelToken& cancel,
+    const SceneImageLoader& loadImage)
+{
+    manuscripta::DiskCache* cache = g_sceneCache;
+    std::string key;
+    if (cache) {
+        // кадр уже был — URL картинки берём с диска; ключ — от UTF-8,
+        // одинаковый на всех платформах
+        key = "scene-" + manuscripta::hashHex(manuscripta::hash64(to_utf8(text)));
+        std::string url;
+        if (cache->Read(key, url)) {
+            SceneApiResponse r{ utf8_to_wstr(url) };
+            if (!r.imageUrl.empty() && (!loadImage || cancel.IsCancelled() || loadImage(r.imageUrl)))
+                return r;
+            // картинки по запомненному адресу больше нет (404, сервер
+            // картинок её удалил) — адрес забываем, API спрашиваем заново
+            if (cancel.IsCancelled()) return r;
+            cache->Remove(key);
+        }
+    }
 
-    return wstr;
+    SceneApiResponse r = fetchSceneRemote(text, cancel);
+    if (r.imageUrl.empty()) return r;
+    if (cache) cache->Write(key, to_utf8(r.imageUrl));
+    if (loadImage && !cancel.IsCancelled()) loadImage(r.imageUrl);
+    return r;
 }
 
+// Общий клиент с пределами по фазам: медленный сервер не держит
+// рабочий поток бесконечно
+static manuscripta::HttpClient& sceneClient()
+{
+    static std::once_flag once;
+    manuscripta::HttpClient& client = manuscripta::HttpClient::Shared();
+    std::call_once(once, [&client] {
+        manuscripta::HttpTimeouts t;
+        t.resolveMs = SCENE_RESOLVE_TIMEOUT_MS;
+        t.connectMs = SCENE_CONNECT_TIMEOUT_MS;
+        t.sendMs = SCENE_SEND_TIMEOUT_MS;
+        t.receiveMs = SCENE_RECEIVE_TIMEOUT_MS;
+        client.SetTimeouts(t);
+        });
+    return client;
+}
 
-SceneApiResponse fetchScene(const std::wstring& text)
+// Пауза перед повтором retry (1, 2, ...): экспонента до SCENE_RETRY_MAX_MS,
+// половина — гарантированно, половина — случайно, чтобы повторы разных
+// кадров не шли залпом
+static std::chrono::milliseconds retryDelay(unsigned retry)
 {
-    const wchar_t* host = L"vps72250.hyperhost.name";
-    const wchar_t* path = L"/api/scene/getScene";
+    const unsigned shift = std::min(retry - 1, 16u);
+    const uint64_t cap = std::min<uint64_t>(uint64_t(SCENE_RETRY_BASE_MS) << shift, SCENE_RETRY_MAX_MS);
+    thread_local std::mt19937 rng{ std::random_device{}() };
+    std::uniform_int_distribution<uint64_t> jitter(0, cap / 2);
+    return std::chrono::milliseconds(cap - cap / 2 + jitter(rng));
+}
 
-    HINTERNET hSession = WinHttpOpen(L"Manuscripta/1.0",
-        WINHTTP_ACCESS_TYPE_NO_PROXY,
-        nullptr, nullptr, 0);
-    if (!hSession) return {};               // 🔹 нет WinHTTP
+enum class SceneReply {
+    Image,          // есть URL картинки
+    NoImage,        // 2xx, но картинки нет — повтор не поможет
+    Rejected,       // прочие не-2xx (4xx): этот сервер запрос не примет — к следующему
+    Failed          // сеть, таймаут, 5xx/429, битый JSON — можно повторить
+};
 
-    HINTERNET hConnect = WinHttpConnect(hSession, host,
-        INTERNET_DEFAULT_HTTP_PORT, 0);
-    if (!hConnect) { WinHttpCloseHandle(hSession); return {}; }
+static SceneReply postScene(const SceneEndpoint& endpoint, const std::string& body,
+    const manuscripta::CancelToken& cancel, std::wstring& imageUrl)
+{
+    // общая сессия: соединение с сервером сцен переиспользуется
+    manuscripta::HttpResponse http;
+    if (!sceneClient().Post(endpoint.host, endpoint.port, endpoint.path, body, http, cancel))
+        return SceneReply::Failed;           // 🔹 сеть не доступна
+    if (http.status >= 500 || http.status == 429)
+        return SceneReply::Failed;
+    if (!http.Ok())
+        return SceneReply::Rejected;
+    const std::string& resp = http.body;
 
-    HINTERNET hRequest = WinHttpOpenRequest(hConnect, L"POST", path,
-        nullptr, WINHTTP_NO_REFERER,
-        WINHTTP_DEFAULT_ACCEPT_TYPES, 0);
-    if (!hRequest) {
-        WinHttpCloseHandle(hConnect); WinHttpCloseHandle(hSession);
-        return {};
+    // безопасный parse
+    json j;
+    try { j = json::parse(resp); }
+    catch (...) { return SceneReply::Failed; }   // 🔹 битый JSON
+
+    if (j.contains("data") && j["data"].contains("image") && j["data"]["image"].is_string()) {
+        imageUrl = utf8_to_wstr(j["data"]["image"].get<std::string>());
+        if (!imageUrl.empty()) return SceneReply::Image;
     }
 
+    return SceneReply::NoImage;              // 🔹 error / пустой
+}
+
+static SceneApiResponse fetchSceneRemote(const std::wstring& text,
+    const manuscripta::CancelToken& cancel)
+{
     // тело запроса
     std::string body = json{ {"text_chunk", 
 //        #ifdef _USE_STYLES 
@@ -73,50 +279,86 @@ SceneApiResponse fetchScene(const std::wstring& text)
         
 
         } }.dump();
-    std::wstring hdr = L"Content-Type: application/json";
-
-    BOOL ok = WinHttpSendRequest(hRequest, hdr.c_str(), (DWORD)-1,
-        (LPVOID)body.data(), (DWORD)body.size(),
-        (DWORD)body.size(), 0);
-    if (!ok) {                               // 🔹 сеть не доступна
-        WinHttpCloseHandle(hRequest);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        return {};                           // → возвращаем «пусто»
-    }
 
-    WinHttpReceiveResponse(hRequest, nullptr);
+    const std::vector<EndpointSlot> endpoints = endpointSlots();
+    ++g_requests;
 
-    // читаем ответ …
-    std::string resp; DWORD sz = 0;
-    do {
-        DWORD n = 0; WinHttpQueryDataAvailable(hRequest, &sz);
-        if (!sz) break;
-        std::string buf(sz, '\0');
-        WinHttpReadData(hRequest, buf.data(), sz, &n);
-        resp.append(buf.data(), n);
-    } while (sz);
+    size_t next = 0;                         // с какого сервера искать
+    size_t rejected = 0;                     // столько серверов отказало (4xx)
+    bool pause = false;                      // повтор после сбоя — с паузой
+    for (unsigned attempt = 0; attempt < std::max(1u, unsigned(SCENE_RETRY_ATTEMPTS)); ++attempt)
+    {
+        if (attempt > 0) {
+            ++g_retries;
+            if (pause && cancel.WaitFor(retryDelay(attempt))) break;
+        }
 
-    WinHttpCloseHandle(hRequest);
-    WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
+        // первый по порядку сервер, чей предохранитель пропускает
+        const EndpointSlot* slot = nullptr;
+        for (size_t k = 0; k < endpoints.size() && !slot; ++k) {
+            const EndpointSlot& s = endpoints[(next + k) % endpoints.size()];
+            if (s.breaker->Allow()) {
+                slot = &s;
+                next = (next + k + 1) % endpoints.size();
+            }
+        }
+        if (!slot) {
+            ++g_shortCircuited;              // все разомкнуты — не ждём мёртвый сервер
+            break;
+        }
 
-    // безопасный parse
-    json j;
-    try { j = json::parse(resp); }
-    catch (...) { return {}; }               // 🔹 битый JSON
+        ++g_attempts;
+        std::wstring url;
+        const SceneReply reply = postScene(slot->endpoint, body, cancel, url);
+        if (cancel.IsCancelled()) break;     // отмена — не сбой сервера
 
-    if (j.contains("data") && j["data"].contains("image"))
-        return { utf8_to_wstr(j["data"]["image"].get<std::string>()) };
+        if (reply == SceneReply::Failed || reply == SceneReply::Rejected) {
+            if (slot->breaker->Failure()) ++g_breakerTrips;
+            // отказ не пройдёт от паузы — сразу следующий сервер, пока
+            // не отказали все
+            pause = reply == SceneReply::Failed;
+            if (reply == SceneReply::Rejected && ++rejected >= endpoints.size()) break;
+            continue;
+        }
+        slot->breaker->Success();                // только за 2xx
+        if (reply == SceneReply::Image) {
+            ++g_succeeded;
+            return { url };
+        }
+        break;
+    }
 
-    return {};                               // 🔹 error / пустой
+    ++g_failed;
+    return {};
 }
 
 
-void fetchSceneAsync(const std::wstring& frameText, std::function<void(SceneApiResponse)> onDone)
+// общий пул вместо потока на каждый кадр
+static manuscripta::WorkerPool& scenePool()
 {
-    std::thread([frameText, onDone]() {
-        SceneApiResponse result = fetchScene(frameText);
+    static manuscripta::WorkerPool pool(SCENE_WORKERS, SCENE_QUEUE_LIMIT);
+    return pool;
+}
+
+void fetchSceneAsync(std::wstring frameText, std::function<void(SceneApiResponse)> onDone,
+    unsigned lookAhead, manuscripta::CancelToken cancel, SceneImageLoader loadImage)
+{
+    auto run = [frameText = std::move(frameText), onDone, cancel, loadImage = std::move(loadImage)]() {
+        // отменён, пока стоял в очереди — сеть не трогаем
+        SceneApiResponse result = cancel.IsCancelled()
+            ? SceneApiResponse{}
+            : fetchScene(frameText, cancel, loadImage);
         if (onDone) onDone(result);
-        }).detach();
+        };
+    auto shed = [onDone]() {
+        if (onDone) onDone(SceneApiResponse{});
+        };
+
+    if (!scenePool().Submit(lookAhead, std::move(run), shed))
+        shed();                              // очередь полна более срочными
+}
+
+void stopSceneFetches()
+{
+    scenePool().Shutdown();
 }
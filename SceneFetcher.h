@@ -1,11 +1,88 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <functional>
+#include <vector>
+#include "CancelToken.h"
+
+namespace manuscripta { class DiskCache; }
 
 struct SceneApiResponse {
     std::wstring imageUrl;
 };
 
-SceneApiResponse fetchScene(const std::wstring& text);
+// Loads the image at url for the caller (into its own cache, a bitmap it
+// keeps, ...); false: the image could not be loaded.
+using SceneImageLoader = std::function<bool(const std::wstring& url)>;
+
+// cancel aborts the request, including a response being read, and a
+// backoff pause.  Failed attempts (no answer, timeout, 5xx/429, broken
+// JSON) are retried up to SCENE_RETRY_ATTEMPTS times in all, with
+// jittered exponential backoff, moving on to the next endpoint each time.
+// Any other non-2xx answer (a wrong path, a server that does not speak
+// this API) moves on to the next endpoint at once; when every endpoint
+// refused, the fetch fails.  Only a 2xx answer counts as a success for
+// the endpoint's circuit breaker.
+// loadImage, if set, is called with the URL found (not after cancel).
+// When it fails for a URL remembered by the scene cache, the image is
+// gone from the server: that entry is dropped and the API is asked again.
+SceneApiResponse fetchScene(const std::wstring& text,
+    const manuscripta::CancelToken& cancel = {}, const SceneImageLoader& loadImage = {});
+
+// Where fetchScene posts frame text.  The default is the production scene
+// API, or the list in the MANUSCRIPTA_SCENE_SERVERS environment variable
+// ("host[:port][/path]" separated by commas), read on first use.
+struct SceneEndpoint {
+    std::wstring host = L"vps72250.hyperhost.name";
+    uint16_t     port = 80;
+    std::wstring path = L"/api/scene/getScene";
+};
+
+// Tried in order.  Each endpoint has a circuit breaker: after
+// SCENE_BREAKER_FAILURES failures in a row it is skipped for
+// SCENE_BREAKER_COOLDOWN_MS (doubling while probes keep failing); with
+// every breaker open a fetch fails at once instead of waiting on a dead
+// server.  Takes effect for requests that start after the call; an
+// empty list restores the default.
+void setSceneEndpoints(const std::vector<SceneEndpoint>& endpoints);
+void setSceneEndpoint(const SceneEndpoint& endpoint);
+std::vector<SceneEndpoint> sceneEndpoints();
+SceneEndpoint sceneEndpoint();                  // the first one
+
+// "host[:port][/path]", optionally with "http://"; parts left out keep
+// the values already in endpoint.  false: malformed, endpoint untouched.
+bool parseSceneEndpoint(std::wstring text, SceneEndpoint& endpoint);
+
+// Counters since start; for logs and the benchmarks
+struct SceneFetchStats {
+    uint64_t requests = 0;          // fetches that reached the network stage
+    uint64_t attempts = 0;          // HTTP requests sent
+    uint64_t retries = 0;
+    uint64_t succeeded = 0;         // got an image URL
+    uint64_t failed = 0;            // gave up, or the server had no image
+    uint64_t shortCircuited = 0;    // every breaker was open: not sent
+    uint64_t breakerTrips = 0;      // a breaker opened
+};
+SceneFetchStats sceneFetchStats();
+
+// Remember frame text -> image URL on disk ("scene-<hash of text>"), so a
+// re-opened book does not ask the scene API again.  nullptr: off.
+// The cache must outlive all fetches.
+void setSceneCache(manuscripta::DiskCache* cache);
+
+// Runs fetchScene on the shared worker pool (SCENE_WORKERS threads).
+// lookAhead: 0 = the frame on screen, n = n frames ahead; lower runs
+// first, equal ones in submission order.  When the queue is full the
+// furthest look-ahead request is shed and its onDone gets an empty
+// response, same as a network failure.
+// A request cancelled before it runs, or while it runs, also ends with an
+// empty response; onDone should check the token before using a result.
+// frameText is moved into the queued job: pass an rvalue to avoid a copy.
+// loadImage runs on the worker before onDone, as in fetchScene.
+void fetchSceneAsync(std::wstring frameText, std::function<void(SceneApiResponse)> onDone,
+    unsigned lookAhead = 0, manuscripta::CancelToken cancel = {}, SceneImageLoader loadImage = {});
 
-void fetchSceneAsync(const std::wstring& frameText, std::function<void(SceneApiResponse)> onDone);
\ No newline at end of file
+// Drop queued requests (their onDone gets an empty response) and wait for
+// running ones; later calls are ignored.
+// Call before the objects that onDone callbacks use are destroyed.
+void stopSceneFetches();
\ No newline at end of file
@@ -0,0 +1,79 @@
+﻿// ScenePrefetcher.cpp — адаптивное окно упреждающих запросов сцен
+#include "ScenePrefetcher.h"
+#include <algorithm>
+#include <cmath>
+
+namespace manuscripta {
+
+    namespace {
+        constexpr double ALPHA = 0.3;           // вес нового замера (EWMA)
+        constexpr double MIN_PACE = 1.0;        // быстрее кадра в секунду не листают
+        constexpr double MAX_PACE = 600.0;      // дольше — пауза, а не чтение
+
+        double seconds(ScenePrefetcher::Clock::duration d)
+        {
+            return std::chrono::duration<double>(d).count();
+        }
+    }
+
+    ScenePrefetcher::ScenePrefetcher(const Config& cfg)
+        : _cfg(cfg), _latency(cfg.initialLatency), _pace(cfg.initialFramePace)
+    {
+        _cfg.minWindow = std::max(1u, _cfg.minWindow);
+        _cfg.maxWindow = std::max(_cfg.minWindow, _cfg.maxWindow);
+        _cfg.maxInFlight = std::max(1u, _cfg.maxInFlight);
+    }
+
+    void ScenePrefetcher::FrameShown(Clock::time_point now)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_lastFrame != Clock::time_point{}) {
+            const double dt = seconds(now - _lastFrame);
+            if (dt < MAX_PACE)                  // после долгой паузы — не замер
+                _pace += ALPHA * (std::max(dt, MIN_PACE) - _pace);
+        }
+        _lastFrame = now;
+    }
+
+    bool ScenePrefetcher::TryStart()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_inFlight >= _cfg.maxInFlight) return false;
+        ++_inFlight;
+        return true;
+    }
+
+    void ScenePrefetcher::Finish(Clock::time_point started, bool ok, Clock::time_point now)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_inFlight) --_inFlight;
+        if (ok)
+            _latency += ALPHA * (seconds(now - started) - _latency);
+    }
+
+    unsigned ScenePrefetcher::Window() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const double n = std::ceil(_latency / std::max(_pace, MIN_PACE)) + 1.0;
+        return unsigned(std::clamp(n, double(_cfg.minWindow), double(_cfg.maxWindow)));
+    }
+
+    unsigned ScenePrefetcher::InFlight() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _inFlight;
+    }
+
+    double ScenePrefetcher::Latency() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _latency;
+    }
+
+    double ScenePrefetcher::FramePace() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _pace;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,54 @@
+﻿#pragma once
+// ScenePrefetcher.h — сколько кадров вперёд держать запрошенными.
+// Окно N (текущий кадр + упреждение) подстраивается под два замера:
+// задержку сервера (запрос сцены + загрузка картинки) и темп чтения
+// (секунд на кадр).  Иллюстрация должна успеть прийти к моменту, когда
+// читатель дойдёт до кадра:  N ≈ ⌈задержка / темп⌉ + 1.
+// Число одновременно выполняемых запросов ограничено бюджетом.
+//
+// Потокобезопасен: Finish() зовут рабочие потоки загрузки, поэтому
+// ReaderPanel держит объект через shared_ptr — колбэки переживают панель.
+#include <chrono>
+#include <mutex>
+
+namespace manuscripta {
+
+    class ScenePrefetcher
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Config
+        {
+            unsigned minWindow = 2;         // текущий + следующий, как раньше
+            unsigned maxWindow = 8;
+            unsigned maxInFlight = 4;       // бюджет одновременных запросов
+            double   initialLatency = 10.0; // с, пока нет замеров
+            double   initialFramePace = 30.0;
+        };
+
+        explicit ScenePrefetcher(const Config& cfg);
+
+        // Читатель перешёл на следующий кадр (замер темпа)
+        void FrameShown(Clock::time_point now = Clock::now());
+
+        // Занять место в бюджете; false — бюджет исчерпан
+        bool TryStart();
+        // Запрос завершён.  ok — картинка получена: её задержка идёт в замер
+        void Finish(Clock::time_point started, bool ok, Clock::time_point now = Clock::now());
+
+        unsigned Window() const;            // кадров, включая текущий
+        unsigned InFlight() const;
+        double   Latency() const;           // сглаженные значения, с
+        double   FramePace() const;
+
+    private:
+        Config            _cfg;
+        mutable std::mutex _mutex;
+        double            _latency;
+        double            _pace;
+        Clock::time_point _lastFrame{};
+        unsigned          _inFlight = 0;
+    };
+
+} // namespace manuscripta
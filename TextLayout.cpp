@@ -0,0 +1,95 @@
+﻿// TextLayout.cpp — инкрементальный перенос строк
+#include "TextLayout.h"
+
+namespace manuscripta {
+
+    void TextLayout::Reset(int maxWidth, int lineHeight)
+    {
+        _lines.clear();
+        _lines.push_back({ 0, 0 });
+        _maxWidth = maxWidth;
+        _lineHeight = lineHeight;
+        _laid = 0;
+        _lineWidth = 0;
+        _breakAt = 0;
+        _widthAtBreak = 0;
+        _dirtyFrom = 0;
+    }
+
+    // Закрыть открытую строку в позиции at и открыть новую с неё же
+    void TextLayout::breakLine(size_t at)
+    {
+        _lines.back().end = at;
+        _lines.push_back({ at, at });
+        _breakAt = 0;
+        _widthAtBreak = 0;
+    }
+
+    void TextLayout::Extend(const wchar_t* text, size_t count, const AdvanceFn& advance)
+    {
+        if (_lines.empty()) Reset(_maxWidth, _lineHeight);
+        if (count > _laid && _dirtyFrom > _lines.size() - 1)
+            _dirtyFrom = _lines.size() - 1;          // открытая строка изменится
+
+        size_t i = _laid;
+        for (; i < count; ++i)
+        {
+            const wchar_t ch = text[i];
+
+            if (ch == L'\n') {                       // жёсткий перенос
+                breakLine(i);
+                _lines.back().start = _lines.back().end = i + 1;
+                _lineWidth = 0;
+                continue;
+            }
+            if (ch == L'\r') {                       // часть \r\n — ширины нет
+                _lines.back().end = i + 1;
+                continue;
+            }
+
+            char32_t cp = static_cast<char32_t>(ch);
+            size_t units = 1;
+            if (ch >= 0xD800 && ch <= 0xDBFF && sizeof(wchar_t) == 2) {
+                if (i + 1 >= count) break;           // вторая половина ещё не видна
+                const wchar_t lo = text[i + 1];
+                if (lo >= 0xDC00 && lo <= 0xDFFF) {
+                    cp = 0x10000 + ((char32_t(ch) - 0xD800) << 10) + (char32_t(lo) - 0xDC00);
+                    units = 2;
+                }
+            }
+
+            const int w = advance(cp);
+            LayoutLine& cur = _lines.back();
+
+            if (ch == L' ' || ch == L'\t') {         // пробелы «висят» за краем
+                _lineWidth += w;
+                cur.end = i + 1;
+                _breakAt = i + 1;
+                _widthAtBreak = _lineWidth;
+                continue;
+            }
+
+            if (_lineWidth + w > _maxWidth && i > cur.start)
+            {
+                if (_breakAt > cur.start) {
+                    // переносим хвостовое слово целиком
+                    const int tail = _lineWidth - _widthAtBreak;
+                    breakLine(_breakAt);
+                    _lineWidth = tail;
+                }
+                if (_lineWidth + w > _maxWidth && i > _lines.back().start) {
+                    // слово длиннее строки — режем посимвольно
+                    breakLine(i);
+                    _lineWidth = 0;
+                }
+            }
+
+            _lineWidth += w;
+            i += units - 1;
+            _lines.back().end = i + 1;
+        }
+
+        if (i > _laid) _laid = i;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,61 @@
+﻿#pragma once
+// TextLayout.h — инкрементальная раскладка текста кадра по строкам.
+// Хранит уже разбитые строки и при появлении новых символов досчитывает
+// только последнюю строку: стоимость одного тика — O(1) амортизированно,
+// вместо полного DrawTextW(DT_CALCRECT) по всему видимому префиксу.
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace manuscripta {
+
+    // Строка раскладки: [start, end) в единицах текста кадра, без '\n'
+    struct LayoutLine
+    {
+        size_t start = 0;
+        size_t end = 0;
+    };
+
+    class TextLayout
+    {
+    public:
+        // Ширина символа (code point) в пикселях — обычно GlyphAdvanceCache
+        using AdvanceFn = std::function<int(char32_t)>;
+
+        // Начать раскладку заново (новый кадр / новая ширина)
+        void Reset(int maxWidth, int lineHeight);
+
+        // Дописать text[Laid() .. count) — text указывает на начало кадра.
+        // Перенос по словам как у DT_WORDBREAK: ломаем по последнему
+        // пробелу строки; слово длиннее строки режется посимвольно.
+        // Суррогатная пара не разрывается: если count попал между её
+        // половинами, старшая половина ждёт следующего вызова.
+        void Extend(const wchar_t* text, size_t count, const AdvanceFn& advance);
+
+        size_t Laid() const { return _laid; }
+        int    MaxWidth() const { return _maxWidth; }
+        int    LineHeight() const { return _lineHeight; }
+        size_t LineCount() const { return _lines.size(); }
+        const LayoutLine& Line(size_t i) const { return _lines[i]; }
+        int    Height() const { return _laid ? static_cast<int>(_lines.size()) * _lineHeight : 0; }
+
+        // Первая строка, изменённая с последнего ClearDirty() (npos — ничего).
+        // Обычно это последняя строка; при переносе слова — предпоследняя.
+        static constexpr size_t npos = static_cast<size_t>(-1);
+        size_t FirstDirtyLine() const { return _dirtyFrom; }
+        void   ClearDirty() { _dirtyFrom = npos; }
+
+    private:
+        void breakLine(size_t at);
+
+        std::vector<LayoutLine> _lines;      // последняя — текущая, «открытая»
+        int    _maxWidth = 0;
+        int    _lineHeight = 0;
+        size_t _laid = 0;                    // сколько символов уже разложено
+        int    _lineWidth = 0;               // ширина открытой строки
+        size_t _breakAt = 0;                 // позиция после последнего пробела (0 — нет)
+        int    _widthAtBreak = 0;            // ширина строки до _breakAt
+        size_t _dirtyFrom = npos;
+    };
+
+} // namespace manuscripta
@@ -0,0 +1,71 @@
+﻿// TextStore.cpp — UTF-8 текст книги, перекодирование по кадрам
+#include "TextStore.h"
+#include "Utf8.h"
+#include <algorithm>
+
+namespace manuscripta {
+
+    void TextStore::Clear()
+    {
+        _file.reset();
+        _mapped = 0;
+        _utf8.clear();
+        _utf8.shrink_to_fit();              // прошлая книга могла быть большой
+        _reserve = 0;
+    }
+
+    std::string& TextStore::own()
+    {
+        if (_utf8.capacity() < _reserve) _utf8.reserve(_reserve);
+        if (_file) {
+            _utf8.assign(Bytes());
+            _file.reset();
+            _mapped = 0;
+        }
+        return _utf8;
+    }
+
+    void TextStore::Append(std::shared_ptr<const MappedFile> file, std::string_view utf8)
+    {
+        if (utf8.empty()) return;
+        const char* const base = file->Bytes().data();
+        const bool continues = _file ? _file == file && utf8.data() == base + _mapped
+            : _utf8.empty() && utf8.data() == base;
+        if (!continues) {
+            Append(utf8);
+            return;
+        }
+        _file = std::move(file);
+        _mapped = size_t(utf8.data() + utf8.size() - base);
+    }
+
+    void TextStore::Append(std::string_view utf8)
+    {
+        if (utf8.empty()) return;
+        own().append(utf8);
+    }
+
+    void TextStore::Append(std::wstring_view text)
+    {
+        own() += wideToUtf8(text);
+    }
+
+    void TextStore::Decode(size_t start, size_t end, std::wstring& out) const
+    {
+        const std::string_view all = Bytes();
+        end = std::min(end, all.size());
+        start = std::min(start, end);
+        const std::string_view bytes = all.substr(start, end - start);
+        if (utf8ToWide(bytes, out)) return;
+        out.clear();
+        utf8ToWideLossy(bytes, out);        // граница посреди символа
+    }
+
+    std::wstring TextStore::Substr(size_t start, size_t end) const
+    {
+        std::wstring out;
+        Decode(start, end, out);
+        return out;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,60 @@
+﻿#pragma once
+// TextStore.h — текст книги в памяти читалки: UTF-8, а не wstring.
+// Книги в основном ASCII / кириллица — в UTF-8 это 1–2 байта на символ
+// против 2 (Windows) / 4 (Linux) байт у wchar_t.
+//
+// Книга в UTF-8 не копируется вовсе: TextStore держит отображение файла
+// (MappedFile) и видит его начало, прочитанное на сейчас.  Свой буфер
+// заводится, только когда текст пришлось перекодировать (ANSI / 1251,
+// испорченный UTF-8, SetText из wstring).
+//
+// Позиции — байты.  Разметка абзацев и кадров (ParagraphIndex) строится
+// прямо по байтам: '\n', '\r', ' ' и '\t' внутри многобайтовых символов
+// не встречаются.  Таблица кадров и служит контрольными точками: в UTF-16
+// (раскладка, GDI) перекодируется только текущий кадр.
+#include "MappedFile.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace manuscripta {
+
+    class TextStore
+    {
+    public:
+        void Clear();
+        // Столько байт займёт свой буфер, если он понадобится (книга
+        // в UTF-8 остаётся в отображении и места не берёт)
+        void Reserve(size_t bytes) { _reserve = bytes; }
+
+        // Дописать валидный UTF-8 из отображения file, символы целиком
+        // (как отдаёт streamTextFileUtf8 с mapped == true).  Продолжение
+        // уже видимого начала file — без копии, иначе копируется.
+        void Append(std::shared_ptr<const MappedFile> file, std::string_view utf8);
+        // Дописать валидный UTF-8 — в свой буфер
+        void Append(std::string_view utf8);
+        // Дописать UTF-16 / UTF-32 — перекодируется в UTF-8
+        void Append(std::wstring_view text);
+
+        std::string_view Bytes() const { return _file ? _file->Bytes().substr(0, _mapped) : std::string_view(_utf8); }
+        size_t Size() const { return _file ? _mapped : _utf8.size(); }
+        bool   Empty() const { return Size() == 0; }
+        char   operator[](size_t pos) const { return _file ? _file->Bytes()[pos] : _utf8[pos]; }
+
+        // Байты [start, end) → wstring; out перезаписывается, его буфер
+        // переиспользуется.  Границы должны лежать на началах символов
+        // (иначе обрывки станут U+FFFD).
+        void Decode(size_t start, size_t end, std::wstring& out) const;
+        std::wstring Substr(size_t start, size_t end) const;
+
+    private:
+        std::string& own();                 // отображённое начало → в свой буфер
+
+        std::shared_ptr<const MappedFile> _file;   // не пусто — текст это _file[0, _mapped)
+        size_t      _mapped = 0;
+        std::string _utf8;                  // иначе — свой буфер
+        size_t      _reserve = 0;
+    };
+
+} // namespace manuscripta
@@ -0,0 +1,476 @@
+﻿// Utf8.cpp — кодеки UTF-8 / UTF-16 / UTF-32 / Windows-1251;
+// UTF-8 → wstring с векторным ASCII-путём
+#include "Utf8.h"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MANUSCRIPTA_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MANUSCRIPTA_AVX2_FN
+#else
+#define MANUSCRIPTA_AVX2_FN __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace manuscripta {
+
+    namespace {
+
+        constexpr bool WIDE_IS_UTF16 = sizeof(wchar_t) == 2;
+        constexpr size_t INVALID = size_t(-1);
+
+        void appendWide(std::wstring& out, char32_t cp)
+        {
+            if (WIDE_IS_UTF16 && cp > 0xFFFF) {
+                cp -= 0x10000;
+                out.push_back(wchar_t(0xD800 + (cp >> 10)));
+                out.push_back(wchar_t(0xDC00 + (cp & 0x3FF)));
+            }
+            else {
+                out.push_back(wchar_t(cp));
+            }
+        }
+
+        void appendUtf8(std::string& out, char32_t cp)
+        {
+            if (cp < 0x80) {
+                out.push_back(char(cp));
+            }
+            else if (cp < 0x800) {
+                out.push_back(char(0xC0 | (cp >> 6)));
+                out.push_back(char(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000) {
+                out.push_back(char(0xE0 | (cp >> 12)));
+                out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(char(0x80 | (cp & 0x3F)));
+            }
+            else {
+                out.push_back(char(0xF0 | (cp >> 18)));
+                out.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+                out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(char(0x80 | (cp & 0x3F)));
+            }
+        }
+
+        // 0x80..0xBF; 0xC0..0xFF — подряд А..я (U+0410..U+044F).
+        // 0x98 в кодировке не занят — как и Windows, отдаём U+0098.
+        constexpr char16_t CP1251_HIGH[64] = {
+            0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,
+            0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+            0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+            0x0098, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+            0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,
+            0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+            0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,
+            0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+        };
+
+        // Длина последовательности по ведущему байту; 0 — не ведущий
+        size_t sequenceLength(unsigned char c)
+        {
+            if (c < 0x80) return 1;
+            if ((c & 0xE0) == 0xC0) return 2;
+            if ((c & 0xF0) == 0xE0) return 3;
+            if ((c & 0xF8) == 0xF0) return 4;
+            return 0;                                 // продолжение без начала, 0xF8+
+        }
+
+        // Одна многобайтовая последовательность с p (*p >= 0x80).
+        // 0 — невалидна (обрыв, overlong, суррогат, > U+10FFFF)
+        size_t decodeSequence(const unsigned char* p, const unsigned char* end, char32_t& cp)
+        {
+            const size_t len = sequenceLength(*p);
+            if (len < 2 || size_t(end - p) < len) return 0;
+
+            static constexpr char32_t MIN[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+            cp = *p & (0x7F >> len);
+            for (size_t i = 1; i < len; ++i) {
+                if ((p[i] & 0xC0) != 0x80) return 0;
+                cp = (cp << 6) | (p[i] & 0x3F);
+            }
+            if (cp < MIN[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+                return 0;
+            return len;
+        }
+
+        wchar_t* putWide(wchar_t* o, char32_t cp)
+        {
+            if (WIDE_IS_UTF16 && cp > 0xFFFF) {
+                cp -= 0x10000;
+                *o++ = wchar_t(0xD800 + (cp >> 10));
+                *o++ = wchar_t(0xDC00 + (cp & 0x3FF));
+            }
+            else {
+                *o++ = wchar_t(cp);
+            }
+            return o;
+        }
+
+        // ─── ASCII-префикс [p, p + n): расширить в o, вернуть длину ───
+        // Векторные версии пишут блок целиком, не глядя, где кончился
+        // ASCII: лишние единицы перезапишет следующий шаг, а за буфер
+        // запись не выходит — до o не больше единиц, чем байтов до p.
+
+        size_t copyAsciiScalar(const unsigned char* p, size_t n, wchar_t* o)
+        {
+            size_t i = 0;
+            while (i < n && p[i] < 0x80) { o[i] = wchar_t(p[i]); ++i; }
+            return i;
+        }
+
+#ifdef MANUSCRIPTA_X86
+        enum class Isa { Sse2, Avx2 };
+
+        Isa detectIsa()
+        {
+#ifdef _MSC_VER
+            int r[4]{};
+            __cpuid(r, 0);
+            if (r[0] < 7) return Isa::Sse2;
+            __cpuid(r, 1);
+            const bool osxsave = (r[2] & (1 << 27)) != 0;
+            const bool avx = (r[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return Isa::Sse2;
+            __cpuidex(r, 7, 0);
+            return (r[1] & (1 << 5)) ? Isa::Avx2 : Isa::Sse2;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? Isa::Avx2 : Isa::Sse2;
+#endif
+        }
+
+        inline unsigned lowestBit(uint32_t m)
+        {
+#ifdef _MSC_VER
+            unsigned long i; _BitScanForward(&i, m); return i;
+#else
+            return static_cast<unsigned>(__builtin_ctz(m));
+#endif
+        }
+
+        // 16 байт → 16 wchar_t
+        inline void widen128(wchar_t* o, __m128i v)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i lo = _mm_unpacklo_epi8(v, zero);
+            const __m128i hi = _mm_unpackhi_epi8(v, zero);
+            if constexpr (WIDE_IS_UTF16) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(o), lo);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 8), hi);
+            }
+            else {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 4), _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 8), _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 12), _mm_unpackhi_epi16(hi, zero));
+            }
+        }
+
+        size_t copyAsciiSse2(const unsigned char* p, size_t n, wchar_t* o)
+        {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+                widen128(o + i, v);
+                const uint32_t m = static_cast<uint32_t>(_mm_movemask_epi8(v));
+                if (m) return i + lowestBit(m);
+            }
+            return i + copyAsciiScalar(p + i, n - i, o + i);
+        }
+
+        MANUSCRIPTA_AVX2_FN size_t copyAsciiAvx2(const unsigned char* p, size_t n, wchar_t* o)
+        {
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32)
+            {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+                const __m128i lo = _mm256_castsi256_si128(v);
+                const __m128i hi = _mm256_extracti128_si256(v, 1);
+                if constexpr (WIDE_IS_UTF16) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i), _mm256_cvtepu8_epi16(lo));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i + 16), _mm256_cvtepu8_epi16(hi));
+                }
+                else {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i), _mm256_cvtepu8_epi32(lo));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i + 16), _mm256_cvtepu8_epi32(hi));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+                }
+                const uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(v));
+                if (m) return i + lowestBit(m);
+            }
+            return i + copyAsciiSse2(p + i, n - i, o + i);
+        }
+#endif
+
+        // ─── то же для проверки без перекодирования: длина ASCII-префикса ───
+
+        size_t skipAsciiScalar(const unsigned char* p, size_t n)
+        {
+            size_t i = 0;
+            while (i < n && p[i] < 0x80) ++i;
+            return i;
+        }
+
+#ifdef MANUSCRIPTA_X86
+        size_t skipAsciiSse2(const unsigned char* p, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+                const uint32_t m = static_cast<uint32_t>(_mm_movemask_epi8(v));
+                if (m) return i + lowestBit(m);
+            }
+            return i + skipAsciiScalar(p + i, n - i);
+        }
+
+        MANUSCRIPTA_AVX2_FN size_t skipAsciiAvx2(const unsigned char* p, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32)
+            {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+                const uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(v));
+                if (m) return i + lowestBit(m);
+            }
+            return i + skipAsciiSse2(p + i, n - i);
+        }
+#endif
+
+        template <size_t (*SkipAscii)(const unsigned char*, size_t)>
+        bool validate(const unsigned char* p, const unsigned char* end)
+        {
+            while (p < end)
+            {
+                p += SkipAscii(p, size_t(end - p));
+                while (p < end && *p >= 0x80)
+                {
+                    char32_t cp;
+                    const size_t len = decodeSequence(p, end, cp);
+                    if (!len) return false;
+                    p += len;
+                }
+            }
+            return true;
+        }
+
+#ifdef MANUSCRIPTA_X86
+        MANUSCRIPTA_AVX2_FN bool validateAvx2(const unsigned char* p, const unsigned char* end)
+        {
+            return validate<skipAsciiAvx2>(p, end);
+        }
+#endif
+
+        // Один проход по [p, stop): ASCII — блоками, многобайтовые
+        // символы (кириллическое слово) — скаляром, с быстрым путём
+        // для 2 байт.  Последний символ может дочитать за stop
+        // (до end) — p сдвигается на фактически прочитанное.  Возвращает
+        // число записанных единиц (не больше прочитанных байтов) или INVALID.
+        template <size_t (*CopyAscii)(const unsigned char*, size_t, wchar_t*)>
+        size_t transcode(const unsigned char*& p, const unsigned char* stop,
+            const unsigned char* end, wchar_t* out)
+        {
+            wchar_t* o = out;
+            while (p < stop)
+            {
+                const size_t ascii = CopyAscii(p, size_t(stop - p), o);
+                p += ascii;
+                o += ascii;
+
+                while (p < stop)
+                {
+                    const unsigned char c = *p;
+                    if (c < 0x80) {
+                        // короткий ASCII между многобайтовыми (пробел, запятая
+                        // в кириллице) — здесь же; длинный — векторному пути
+                        size_t k = 0;
+                        while (k < 8 && p + k < stop && p[k] < 0x80) { o[k] = wchar_t(p[k]); ++k; }
+                        p += k;
+                        o += k;
+                        if (k == 8) break;
+                        continue;
+                    }
+                    if (c >= 0xC2 && c < 0xE0 && end - p >= 2 && (p[1] & 0xC0) == 0x80) {
+                        *o++ = wchar_t(((c & 0x1F) << 6) | (p[1] & 0x3F));
+                        p += 2;
+                        continue;
+                    }
+                    char32_t cp;
+                    const size_t len = decodeSequence(p, end, cp);
+                    if (!len) return INVALID;
+                    o = putWide(o, cp);
+                    p += len;
+                }
+            }
+            return size_t(o - out);
+        }
+
+#ifdef MANUSCRIPTA_X86
+        MANUSCRIPTA_AVX2_FN size_t transcodeAvx2(const unsigned char*& p, const unsigned char* stop,
+            const unsigned char* end, wchar_t* out)
+        {
+            return transcode<copyAsciiAvx2>(p, stop, end, out);
+        }
+#endif
+
+        // out растёт блоками по 64 КБ входа: обнуление при resize и
+        // запись декодера идут по одним и тем же строкам кэша, а не
+        // двумя проходами по мегабайтам книги
+        template <class Transcode>
+        bool toWide(std::string_view src, std::wstring& out, Transcode fn)
+        {
+            constexpr size_t BLOCK = 64 * 1024;
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(src.data());
+            const unsigned char* end = p + src.size();
+
+            out.clear();
+            out.reserve(src.size());
+            size_t units = 0;
+            while (p < end)
+            {
+                const size_t block = std::min(BLOCK, size_t(end - p));
+                out.resize(units + block + 3);      // + хвост символа за границей блока
+                const size_t n = fn(p, p + block, end, out.data() + units);
+                if (n == INVALID) {
+                    out.clear();
+                    return false;
+                }
+                units += n;
+            }
+            out.resize(units);
+            return true;
+        }
+
+    } // namespace
+
+    bool utf8ToWide(std::string_view src, std::wstring& out)
+    {
+#ifdef MANUSCRIPTA_X86
+        static const Isa isa = detectIsa();
+        if (isa == Isa::Avx2) return toWide(src, out, transcodeAvx2);
+        return toWide(src, out, transcode<copyAsciiSse2>);
+#else
+        return toWide(src, out, transcode<copyAsciiScalar>);
+#endif
+    }
+
+    bool utf8ToWideScalar(std::string_view src, std::wstring& out)
+    {
+        return toWide(src, out, transcode<copyAsciiScalar>);
+    }
+
+    bool utf8Valid(std::string_view src)
+    {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(src.data());
+        const unsigned char* end = p + src.size();
+#ifdef MANUSCRIPTA_X86
+        static const Isa isa = detectIsa();
+        if (isa == Isa::Avx2) return validateAvx2(p, end);
+        return validate<skipAsciiSse2>(p, end);
+#else
+        return validate<skipAsciiScalar>(p, end);
+#endif
+    }
+
+    size_t asciiPrefix(std::string_view src)
+    {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(src.data());
+#ifdef MANUSCRIPTA_X86
+        static const Isa isa = detectIsa();
+        if (isa == Isa::Avx2) return skipAsciiAvx2(p, src.size());
+        return skipAsciiSse2(p, src.size());
+#else
+        return skipAsciiScalar(p, src.size());
+#endif
+    }
+
+    const char* utf8Isa()
+    {
+#ifdef MANUSCRIPTA_X86
+        static const Isa isa = detectIsa();
+        return isa == Isa::Avx2 ? "avx2" : "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void utf8ToWideLossy(std::string_view src, std::wstring& out)
+    {
+        out.reserve(out.size() + src.size());
+
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(src.data());
+        const unsigned char* end = p + src.size();
+        while (p < end)
+        {
+            if (*p < 0x80) {
+                out.push_back(wchar_t(*p));
+                ++p;
+                continue;
+            }
+            char32_t cp;
+            const size_t len = decodeSequence(p, end, cp);
+            appendWide(out, len ? cp : 0xFFFD);
+            p += len ? len : 1;
+        }
+    }
+
+    size_t utf8CompletePrefix(std::string_view src)
+    {
+        // ведущий байт — не дальше 3 байт от конца
+        const size_t n = src.size();
+        for (size_t back = 1; back <= 3 && back <= n; ++back)
+        {
+            const unsigned char c = static_cast<unsigned char>(src[n - back]);
+            if ((c & 0xC0) == 0x80) continue;         // продолжение — ищем начало
+            const size_t len = sequenceLength(c);
+            return len > back ? n - back : n;         // не хватает байтов — переносим
+        }
+        return n;
+    }
+
+    std::string wideToUtf8(std::wstring_view src)
+    {
+        std::string out;
+        out.reserve(src.size());
+
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            char32_t cp = char32_t(src[i]);
+            if (WIDE_IS_UTF16) {
+                cp &= 0xFFFF;
+                if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < src.size()) {
+                    const char32_t lo = char32_t(src[i + 1]) & 0xFFFF;
+                    if (lo >= 0xDC00 && lo <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        ++i;
+                    }
+                }
+            }
+            if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+                cp = 0xFFFD;
+            appendUtf8(out, cp);
+        }
+        return out;
+    }
+
+    std::wstring cp1251ToWide(std::string_view src)
+    {
+        std::wstring out;
+        out.resize(src.size());
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            const unsigned char c = static_cast<unsigned char>(src[i]);
+            out[i] = c < 0x80 ? wchar_t(c)
+                : c < 0xC0 ? wchar_t(CP1251_HIGH[c - 0x80])
+                : wchar_t(0x0410 + (c - 0xC0));
+        }
+        return out;
+    }
+
+} // namespace manuscripta
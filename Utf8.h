@@ -0,0 +1,46 @@
+﻿#pragma once
+// Utf8.h — UTF-8 ⇄ std::wstring без Win32.  wchar_t на Windows —
+// UTF-16 (суррогатные пары), на Linux — UTF-32; модуль знает оба
+// варианта, так что загрузка книги и запросы сцен собираются и без
+// MultiByteToWideChar (пакетная подготовка сцен на Linux).
+#include <string>
+#include <string_view>
+
+namespace manuscripta {
+
+    // Строгое декодирование: false — в src невалидный UTF-8 (обрывки
+    // последовательностей, overlong, суррогаты, > U+10FFFF), out не
+    // определён.  То же, что MultiByteToWideChar(MB_ERR_INVALID_CHARS).
+    // Один проход: проверка и перекодирование вместе, out размечается
+    // один раз (единиц не больше, чем байтов).  ASCII идёт блоками по
+    // 16/32 байта (SSE2 / AVX2, выбор в рантайме), многобайтовые
+    // символы — скаляром; на невалидном байте — сразу выход.
+    bool utf8ToWide(std::string_view src, std::wstring& out);
+    // Тот же проход без SIMD (для бенчмарка и сверки)
+    bool utf8ToWideScalar(std::string_view src, std::wstring& out);
+    // Только проверка (те же правила, что у utf8ToWide), без вывода —
+    // для текста, который дальше хранится в UTF-8 как есть
+    bool utf8Valid(std::string_view src);
+    // Длина начального участка из одних ASCII-байтов (тот же SIMD-проход):
+    // пока он тянется до конца, текст одинаков и в UTF-8, и в ANSI
+    size_t asciiPrefix(std::string_view src);
+    // Какая реализация выбрана на этой машине: "avx2", "sse2" или "scalar"
+    const char* utf8Isa();
+
+    // Нестрогое: каждый невалидный байт → U+FFFD (как
+    // MultiByteToWideChar без MB_ERR_INVALID_CHARS).  Дописывает в out.
+    void utf8ToWideLossy(std::string_view src, std::wstring& out);
+
+    // Длина src без многобайтовой последовательности, оборванной в
+    // самом конце (0..3 байта): при чтении блоками хвост переносится
+    // в следующий блок
+    size_t utf8CompletePrefix(std::string_view src);
+
+    // Одинокие суррогаты (только UTF-16) заменяются на U+FFFD
+    std::string wideToUtf8(std::wstring_view src);
+
+    // Windows-1251 → wstring: запасной вариант для «ANSI»-книг там,
+    // где нет CP_ACP
+    std::wstring cp1251ToWide(std::string_view src);
+
+} // namespace manuscripta
@@ -0,0 +1,100 @@
+﻿// WorkerPool.cpp — пул потоков с ограниченной очередью приоритетов
+#include "WorkerPool.h"
+#include <algorithm>
+#include <iterator>
+
+namespace manuscripta {
+
+    WorkerPool::WorkerPool(unsigned threads, size_t capacity)
+        : _capacity(std::max<size_t>(1, capacity))
+    {
+        threads = std::max(1u, threads);
+        _threads.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i)
+            _threads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        Shutdown();
+    }
+
+    bool WorkerPool::Submit(unsigned priority, Task task, Task onDrop)
+    {
+        Task dropped;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stop) return false;
+
+            if (_queue.size() >= _capacity)
+            {
+                auto worst = std::prev(_queue.end());
+                if (worst->priority <= priority) {   // новая — не лучше
+                    ++_dropped;
+                    return false;
+                }
+                dropped = std::move(worst->onDrop);
+                _queue.erase(worst);
+                ++_dropped;
+            }
+            _queue.insert(Item{ priority, _seq++, std::move(task), std::move(onDrop) });
+        }
+        _cv.notify_one();
+
+        if (dropped) dropped();                      // вне блокировки
+        return true;
+    }
+
+    void WorkerPool::workerLoop()
+    {
+        for (;;)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] { return _stop || !_queue.empty(); });
+                if (_stop) return;
+                task = std::move(_queue.begin()->task);
+                _queue.erase(_queue.begin());
+            }
+            try { task(); }
+            catch (...) {}                           // задача не роняет пул
+        }
+    }
+
+    void WorkerPool::Shutdown()
+    {
+        std::vector<Task> dropped;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stop) return;
+            _stop = true;
+            for (const Item& item : _queue)
+                if (item.onDrop) dropped.push_back(std::move(item.onDrop));
+            _dropped += _queue.size();
+            _queue.clear();
+        }
+        _cv.notify_all();
+
+        for (Task& onDrop : dropped) onDrop();       // вне блокировки
+        for (std::thread& t : _threads)
+        {
+            if (t.get_id() == std::this_thread::get_id()) t.detach();   // из задачи
+            else if (t.joinable()) t.join();
+        }
+        _threads.clear();
+    }
+
+    size_t WorkerPool::Pending() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _queue.size();
+    }
+
+    size_t WorkerPool::Dropped() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _dropped;
+    }
+
+} // namespace manuscripta
@@ -0,0 +1,66 @@
+﻿#pragma once
+// WorkerPool.h — фиксированное число рабочих потоков и ограниченная
+// очередь с приоритетами вместо «поток на каждый запрос».
+// Меньший priority — раньше; при равном — в порядке постановки.
+// Очередь полна → задача с худшим приоритетом вытесняется (вызывается
+// её onDrop), а если худшая — сама новая, Submit возвращает false.
+// Поток UI никогда не ждёт очередь.
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace manuscripta {
+
+    class WorkerPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        WorkerPool(unsigned threads, size_t capacity);
+        ~WorkerPool();                  // = Shutdown()
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        // false — задача не принята (очередь полна задачами не хуже
+        // или пул остановлен); onDrop тогда не вызывается
+        bool Submit(unsigned priority, Task task, Task onDrop = {});
+
+        // Выбросить очередь (onDrop каждой — вне блокировки) и дождаться
+        // текущих задач.  Дальнейшие Submit отклоняются.
+        void Shutdown();
+
+        size_t Pending() const;
+        size_t Dropped() const;
+
+    private:
+        struct Item
+        {
+            unsigned priority;
+            uint64_t seq;
+            mutable Task task;
+            mutable Task onDrop;
+
+            bool operator<(const Item& o) const
+            {
+                return priority != o.priority ? priority < o.priority : seq < o.seq;
+            }
+        };
+
+        void workerLoop();
+
+        mutable std::mutex      _mutex;
+        std::condition_variable _cv;
+        std::set<Item>          _queue;     // begin — следующая, rbegin — худшая
+        std::vector<std::thread> _threads;
+        size_t   _capacity;
+        uint64_t _seq = 0;
+        size_t   _dropped = 0;
+        bool     _stop = false;
+    };
+
+} // namespace manuscripta
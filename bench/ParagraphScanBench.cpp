@@ -0,0 +1,130 @@
+﻿// ParagraphScanBench.cpp — микро-бенчмарк разметки абзацев
+// Сравнивает прежний посимвольный цикл ReaderPanel::findNextParagraph
+// с векторным findParagraphBreak на многомегабайтном тексте.
+//
+// g++ -O2 -std=c++20 -I.. ParagraphScanBench.cpp ../NewlineScan.cpp -o scanbench
+// cl /O2 /EHsc /std:c++20 /I.. ParagraphScanBench.cpp ..\NewlineScan.cpp
+//
+// scanbench [MB]   (по умолчанию 64 МБ на каждую кодировку)
+#include "NewlineScan.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace {
+
+    // Синтетическая «книга»: слова, одиночные переводы строк внутри
+    // абзаца и пустая строка между абзацами (\n\n или \r\n\r\n).
+    template <class Ch>
+    std::basic_string<Ch> makeText(size_t bytes, bool crlf)
+    {
+        std::mt19937 rng(42);
+        std::basic_string<Ch> s;
+        s.reserve(bytes / sizeof(Ch) + 64);
+        while (s.size() * sizeof(Ch) < bytes)
+        {
+            int sentences = 3 + rng() % 8;
+            for (int i = 0; i < sentences; ++i)
+            {
+                int words = 4 + rng() % 12;
+                for (int w = 0; w < words; ++w)
+                {
+                    int len = 2 + rng() % 9;
+                    for (int c = 0; c < len; ++c) s.push_back(Ch('a' + rng() % 26));
+                    s.push_back(Ch(' '));
+                }
+                s.push_back(Ch('.'));
+                if (rng() % 4 == 0) { if (crlf) s.push_back(Ch('\r')); s.push_back(Ch('\n')); }
+            }
+            if (crlf) { s.push_back(Ch('\r')); s.push_back(Ch('\n')); s.push_back(Ch('\r')); }
+            else s.push_back(Ch('\n'));
+            s.push_back(Ch('\n'));
+        }
+        return s;
+    }
+
+    // Прежний цикл из ReaderPanel::findNextParagraph (count = 1)
+    template <class Ch>
+    size_t legacyNext(const std::basic_string<Ch>& t, size_t pos)
+    {
+        while (pos < t.size())
+        {
+            if (pos + 1 < t.size() && t[pos] == Ch('\n') && t[pos + 1] == Ch('\n'))
+                return pos + 2;
+            if (pos + 3 < t.size() &&
+                t[pos] == Ch('\r') && t[pos + 1] == Ch('\n') &&
+                t[pos + 2] == Ch('\r') && t[pos + 3] == Ch('\n'))
+                return pos + 4;
+            ++pos;
+        }
+        return pos;
+    }
+
+    template <class F>
+    double bestSeconds(F&& f, size_t& sink)
+    {
+        double best = 1e30;
+        for (int rep = 0; rep < 5; ++rep)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            sink += f();
+            auto t1 = std::chrono::steady_clock::now();
+            double s = std::chrono::duration<double>(t1 - t0).count();
+            if (s < best) best = s;
+        }
+        return best;
+    }
+
+    template <class Ch>
+    void run(const char* name, size_t bytes, bool crlf)
+    {
+        const std::basic_string<Ch> text = makeText<Ch>(bytes, crlf);
+        const double mb = double(text.size() * sizeof(Ch)) / (1024.0 * 1024.0);
+        size_t sink = 0, breaksLegacy = 0, breaksScalar = 0, breaksSimd = 0;
+
+        double tLegacy = bestSeconds([&] {
+            size_t n = 0;
+            for (size_t pos = 0; pos < text.size(); ++n) pos = legacyNext(text, pos);
+            breaksLegacy = n;
+            return n;
+        }, sink);
+
+        auto scan = [&](auto fn, size_t& count) {
+            size_t n = 0, pos = 0;
+            unsigned len = 0;
+            while ((pos = fn(text.data(), text.size(), pos, len)) < text.size()) { pos += len; ++n; }
+            count = n;
+            return n;
+        };
+        double tScalar = bestSeconds([&] {
+            return scan([](const Ch* p, size_t l, size_t f, unsigned& b) {
+                return manuscripta::findParagraphBreakScalar(p, l, f, b); }, breaksScalar);
+        }, sink);
+        double tSimd = bestSeconds([&] {
+            return scan([](const Ch* p, size_t l, size_t f, unsigned& b) {
+                return manuscripta::findParagraphBreak(p, l, f, b); }, breaksSimd);
+        }, sink);
+
+        std::printf("%-14s %s %7.1f MB  legacy %8.0f MB/s  scalar %8.0f MB/s  %s %8.0f MB/s  x%.1f  (%zu breaks%s)\n",
+            name, crlf ? "CRLF" : "LF  ", mb,
+            mb / tLegacy, mb / tScalar, manuscripta::newlineScanIsa(), mb / tSimd, tLegacy / tSimd,
+            breaksSimd, (breaksScalar == breaksSimd && breaksLegacy - breaksSimd <= 1) ? "" : ", MISMATCH");
+        if (sink == 42) std::puts("");
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    size_t bytes = mb * 1024 * 1024;
+
+    run<char>("UTF-8", bytes, false);
+    run<char>("UTF-8", bytes, true);
+    run<char16_t>("UTF-16", bytes, false);
+    run<char16_t>("UTF-16", bytes, true);
+    run<wchar_t>("wchar_t", bytes, false);
+    return 0;
+}
@@ -0,0 +1,239 @@
+﻿// SceneBench.cpp — сквозной бенчмарк: кадр → fetchScene → загрузка →
+// декодирование картинки, против локального tools/mock_scene_server.py.
+// Печатает p50/p95/p99/max по этапам и пропускную способность при
+// заданном числе одновременных кадров (замкнутый цикл: каждый поток
+// берёт следующий кадр, как только закончил предыдущий).
+//
+// Linux (картинка только скачивается — GDI+ нет):
+// g++ -O2 -std=c++20 -pthread -I.. SceneBench.cpp ../Prewarm.cpp ../SceneFetcher.cpp ../HttpClient.cpp ../HttpClientPosix.cpp ../DiskCache.cpp ../WorkerPool.cpp ../CancelToken.cpp ../ParagraphIndex.cpp ../NewlineScan.cpp ../FileLoader.cpp ../Utf8.cpp ../CircuitBreaker.cpp ../MappedFile.cpp -o scenebench
+// Windows (urlmon + GDI+ через ImageCache, как в читалке):
+// cl /O2 /EHsc /std:c++20 /DUNICODE /D_UNICODE /I.. SceneBench.cpp ..\Prewarm.cpp ..\SceneFetcher.cpp ..\HttpClient.cpp ..\HttpClientPosix.cpp ..\DiskCache.cpp ..\WorkerPool.cpp ..\CancelToken.cpp ..\ParagraphIndex.cpp ..\NewlineScan.cpp ..\FileLoader.cpp ..\Utf8.cpp ..\CircuitBreaker.cpp ..\MappedFile.cpp ..\ImageCache.cpp user32.lib gdi32.lib ole32.lib comdlg32.lib
+//
+// python3 ../tools/mock_scene_server.py --port 8080 --scene-latency 300 --scene-jitter 100 &
+// scenebench [--server 127.0.0.1:8080]... [--frames 200] [--concurrency 4] [--book book.txt]
+// (повторный --server — запасной сервер: проверка отказоустойчивости)
+#include "HttpClient.h"
+#include "FileLoader.h"
+#include "Prewarm.h"
+#include "SceneFetcher.h"
+#include "Utf8.h"
+#include "config.h"
+#ifdef _WIN32
+#include "ImageCache.h"
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    double msSince(Clock::time_point t)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+    }
+
+    // Синтетическая книга: абзацы из случайных слов через пустую строку
+    std::wstring makeBook(size_t paragraphs)
+    {
+        std::mt19937 rng(42);
+        std::wstring s;
+        for (size_t p = 0; p < paragraphs; ++p)
+        {
+            const int words = 20 + rng() % 60;
+            for (int w = 0; w < words; ++w)
+            {
+                const int len = 2 + rng() % 9;
+                for (int c = 0; c < len; ++c) s.push_back(wchar_t(L'a' + rng() % 26));
+                s.push_back(L' ');
+            }
+            s += L".\n\n";
+        }
+        return s;
+    }
+
+    struct Sample
+    {
+        double scene = 0;       // fetchScene, мс
+        double image = 0;       // загрузка (+ декодирование), мс
+        bool   sceneOk = false;
+        bool   imageOk = false;
+    };
+
+    // Ближайший ранг; v отсортирован
+    double percentile(const std::vector<double>& v, double q)
+    {
+        if (v.empty()) return 0.0;
+        const size_t rank = size_t(q * double(v.size()) + 0.999999);
+        return v[std::min(v.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+
+    void printRow(const char* name, std::vector<double> v)
+    {
+        std::sort(v.begin(), v.end());
+        std::printf("%-28s %9.1f %9.1f %9.1f %9.1f %7zu\n", name,
+            percentile(v, 0.50), percentile(v, 0.95), percentile(v, 0.99),
+            v.empty() ? 0.0 : v.back(), v.size());
+    }
+
+    std::wstring widen(const char* s)
+    {
+        std::wstring w;
+        if (!manuscripta::utf8ToWide(s, w)) w = manuscripta::cp1251ToWide(s);
+        return w;
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t frames = 200;
+    unsigned concurrency = SCENE_WORKERS;
+    std::wstring book;
+    std::vector<SceneEndpoint> endpoints;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--frames") && hasValue) frames = std::strtoul(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--concurrency") && hasValue) concurrency = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--book") && hasValue) book = widen(argv[++i]);
+        else if (!std::strcmp(argv[i], "--server") && hasValue) {
+            SceneEndpoint ep;
+            if (!parseSceneEndpoint(widen(argv[++i]), ep)) return 2;
+            endpoints.push_back(ep);
+        }
+        else {
+            std::fprintf(stderr, "usage: scenebench [--server host:port]... [--frames N] "
+                "[--concurrency N] [--book file.txt]\n");
+            return 2;
+        }
+    }
+    if (frames == 0 || concurrency == 0) return 2;
+
+    // кадры — как в читалке; не хватило книги — по кругу, с номером,
+    // чтобы ни сервер, ни кэш картинок не узнали повтор
+    std::vector<std::wstring> source;
+    try {
+        if (book.empty())
+            source = manuscripta::splitFrames(makeBook(frames * SKIP_ENDS), SKIP_ENDS);
+        else {
+            const manuscripta::BookFrames bookFrames(book, SKIP_ENDS);
+            for (size_t n = 0; n < bookFrames.Count(); ++n)
+                source.push_back(bookFrames.Frame(n));
+        }
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    source.erase(std::remove(source.begin(), source.end(), std::wstring()), source.end());
+    if (source.empty()) return 1;
+
+    std::vector<std::wstring> work;
+    for (size_t i = 0; i < frames; ++i)
+    {
+        std::wstring f = source[i % source.size()];
+        if (i >= source.size()) f += L" #" + std::to_wstring(i / source.size());
+        work.push_back(std::move(f));
+    }
+
+    if (endpoints.empty()) {
+        SceneEndpoint local;
+        local.host = L"127.0.0.1";
+        local.port = 8080;
+        endpoints.push_back(local);
+    }
+    setSceneEndpoints(endpoints);
+    const SceneEndpoint& endpoint = endpoints.front();
+    manuscripta::HttpClient::Shared().SetMaxConnsPerHost(concurrency);
+
+#ifdef _WIN32
+    ImageCache images;
+    const manuscripta::ImageStage image = [&images](const std::wstring& url) {
+        HBITMAP bmp = images.Get(url);
+        if (!bmp) return false;
+        images.Release(bmp);
+        return true;
+        };
+    const char* imageRow = "image (download + decode)";
+#else
+    const manuscripta::ImageStage image = [](const std::wstring& url) {
+        manuscripta::HttpResponse http;
+        return manuscripta::HttpClient::Shared().Get(url, http) && http.Ok() && !http.body.empty();
+        };
+    const char* imageRow = "image (download)";
+#endif
+
+    std::vector<Sample> samples(work.size());
+    std::atomic<size_t> next{ 0 };
+    const Clock::time_point start = Clock::now();
+    {
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < concurrency; ++t)
+            threads.emplace_back([&] {
+                for (size_t i; (i = next++) < work.size();)
+                {
+                    Sample& s = samples[i];
+                    Clock::time_point t0 = Clock::now();
+                    const SceneApiResponse scene = fetchScene(work[i]);
+                    s.scene = msSince(t0);
+                    s.sceneOk = !scene.imageUrl.empty();
+                    if (!s.sceneOk) continue;
+
+                    t0 = Clock::now();
+                    s.imageOk = image(scene.imageUrl);
+                    s.image = msSince(t0);
+                }
+                });
+        for (std::thread& t : threads) t.join();
+    }
+    const double wall = msSince(start) / 1000.0;
+
+    std::vector<double> scene, img, total;
+    size_t sceneFailed = 0, imageFailed = 0;
+    for (const Sample& s : samples)
+    {
+        if (!s.sceneOk) { ++sceneFailed; continue; }
+        scene.push_back(s.scene);
+        if (!s.imageOk) { ++imageFailed; continue; }
+        img.push_back(s.image);
+        total.push_back(s.scene + s.image);
+    }
+
+    std::printf("%zu frames, %u at a time, %s:%u%s\n", work.size(), concurrency,
+        manuscripta::wideToUtf8(endpoint.host).c_str(), unsigned(endpoint.port),
+        manuscripta::wideToUtf8(endpoint.path).c_str());
+    std::printf("%-28s %9s %9s %9s %9s %7s\n", "ms", "p50", "p95", "p99", "max", "n");
+    printRow("scene (fetchScene)", scene);
+    printRow(imageRow, img);
+    printRow("frame total", total);
+    std::printf("%.2f s, %.2f frames/s (%.2f complete/s); failed: %zu scene, %zu image\n",
+        wall, double(work.size()) / wall, double(total.size()) / wall, sceneFailed, imageFailed);
+
+    const manuscripta::HttpMetrics m = manuscripta::HttpClient::Shared().Metrics();
+    const double answered = double(m.requests - m.failures);
+    if (answered > 0)
+        std::printf("http: %llu requests, %.0f%% connections reused, avg connect %.2f ms, "
+            "wait %.2f ms, read %.2f ms\n",
+            (unsigned long long)m.requests, m.ReuseRate() * 100.0,
+            double(m.connectUs) / answered / 1000.0, double(m.waitUs) / answered / 1000.0,
+            double(m.readUs) / answered / 1000.0);
+
+    const SceneFetchStats f = sceneFetchStats();
+    std::printf("scene API: %llu attempts, %llu retries, %llu timeouts, %llu breaker trips, "
+        "%llu short-circuited\n",
+        (unsigned long long)f.attempts, (unsigned long long)f.retries,
+        (unsigned long long)m.timeouts, (unsigned long long)f.breakerTrips,
+        (unsigned long long)f.shortCircuited);
+    return 0;
+}
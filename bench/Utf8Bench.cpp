@@ -0,0 +1,179 @@
+﻿// Utf8Bench.cpp — микро-бенчмарк UTF-8 → wstring (загрузка книги)
+// Сравнивает прежний посимвольный utf8ToWide (push_back на каждый
+// символ), тот же однопроходный декодер без SIMD и векторный ASCII-путь;
+// на Windows — ещё MultiByteToWideChar в два прохода, как раньше делал
+// loadTextFileW.  Проверяет, что все дают одинаковый результат.
+//
+// g++ -O2 -std=c++20 -I.. Utf8Bench.cpp ../Utf8.cpp -o utf8bench
+// cl /O2 /EHsc /std:c++20 /I.. Utf8Bench.cpp ..\Utf8.cpp
+//
+// utf8bench [MB] [book.txt]...   (по умолчанию 64 МБ на каждый корпус)
+#include "Utf8.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace {
+
+    // Синтетическая «книга» из слов заданного алфавита; абзацы через
+    // пустую строку.  emoji — изредка символ вне BMP (суррогатная пара)
+    std::string makeText(size_t bytes, const std::vector<std::string>& letters, bool emoji)
+    {
+        std::mt19937 rng(42);
+        std::string s;
+        s.reserve(bytes + 64);
+        while (s.size() < bytes)
+        {
+            int words = 20 + rng() % 60;
+            for (int w = 0; w < words; ++w)
+            {
+                int len = 2 + rng() % 9;
+                for (int c = 0; c < len; ++c) s += letters[rng() % letters.size()];
+                s += (rng() % 10 == 0) ? ", " : " ";
+                if (emoji && rng() % 50 == 0) s += "\xF0\x9F\x93\x96 ";     // U+1F4D6
+            }
+            s += ".\n\n";
+        }
+        return s;
+    }
+
+    std::vector<std::string> latin()
+    {
+        std::vector<std::string> v;
+        for (char c = 'a'; c <= 'z'; ++c) v.push_back(std::string(1, c));
+        return v;
+    }
+
+    std::vector<std::string> cyrillic()
+    {
+        std::vector<std::string> v;
+        for (char32_t c = 0x430; c <= 0x44F; ++c)
+            v.push_back({ char(0xC0 | (c >> 6)), char(0x80 | (c & 0x3F)) });
+        return v;
+    }
+
+    // Прежний manuscripta::utf8ToWide: строгий, посимвольно в push_back
+    bool legacyUtf8ToWide(std::string_view src, std::wstring& out)
+    {
+        out.clear();
+        out.reserve(src.size());
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(src.data());
+        const unsigned char* end = p + src.size();
+        while (p < end)
+        {
+            const unsigned char c = *p;
+            if (c < 0x80) { out.push_back(wchar_t(c)); ++p; continue; }
+
+            size_t len;
+            char32_t cp, min;
+            if (c >= 0xC2 && c <= 0xDF) { len = 2; cp = c & 0x1F; min = 0x80; }
+            else if (c >= 0xE0 && c <= 0xEF) { len = 3; cp = c & 0x0F; min = 0x800; }
+            else if (c >= 0xF0 && c <= 0xF4) { len = 4; cp = c & 0x07; min = 0x10000; }
+            else return false;
+            if (size_t(end - p) < len) return false;
+            for (size_t i = 1; i < len; ++i) {
+                if ((p[i] & 0xC0) != 0x80) return false;
+                cp = (cp << 6) | (p[i] & 0x3F);
+            }
+            if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+
+            if (sizeof(wchar_t) == 2 && cp > 0xFFFF) {
+                cp -= 0x10000;
+                out.push_back(wchar_t(0xD800 + (cp >> 10)));
+                out.push_back(wchar_t(0xDC00 + (cp & 0x3FF)));
+            }
+            else out.push_back(wchar_t(cp));
+            p += len;
+        }
+        return true;
+    }
+
+#ifdef _WIN32
+    // Прежний loadTextFileW: размер, затем перекодирование
+    bool winUtf8ToWide(std::string_view src, std::wstring& out)
+    {
+        int n = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS,
+            src.data(), int(src.size()), nullptr, 0);
+        if (n == 0) return false;
+        out.assign(n, L'\0');
+        MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS,
+            src.data(), int(src.size()), out.data(), n);
+        return true;
+    }
+#endif
+
+    template <class F>
+    double bestSeconds(F&& f, size_t& sink)
+    {
+        double best = 1e30;
+        for (int rep = 0; rep < 5; ++rep)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            sink += f();
+            auto t1 = std::chrono::steady_clock::now();
+            double s = std::chrono::duration<double>(t1 - t0).count();
+            if (s < best) best = s;
+        }
+        return best;
+    }
+
+    void run(const char* name, const std::string& text)
+    {
+        const double gb = double(text.size()) / (1024.0 * 1024.0 * 1024.0);
+        size_t sink = 0;
+        std::wstring legacy, scalar, simd;
+        bool ok = true;
+
+        auto time = [&](auto fn, std::wstring& out) {
+            return bestSeconds([&] { ok &= fn(text, out); return out.size(); }, sink);
+        };
+        double tLegacy = time(legacyUtf8ToWide, legacy);
+        double tScalar = time(manuscripta::utf8ToWideScalar, scalar);
+        double tSimd = time(manuscripta::utf8ToWide, simd);
+        bool same = ok && legacy == scalar && legacy == simd;
+#ifdef _WIN32
+        std::wstring win;
+        double tWin = time(winUtf8ToWide, win);
+        same = same && win == simd;
+        std::printf("%-10s %7.1f MB  MultiByteToWideChar %5.2f GB/s ",
+            name, gb * 1024.0, gb / tWin);
+#else
+        std::printf("%-10s %7.1f MB ", name, gb * 1024.0);
+#endif
+        std::printf(" legacy %5.2f GB/s  scalar %5.2f GB/s  %s %5.2f GB/s  x%.1f%s\n",
+            gb / tLegacy, gb / tScalar, manuscripta::utf8Isa(), gb / tSimd, tLegacy / tSimd,
+            same ? "" : "  MISMATCH");
+        if (sink == 42) std::puts("");
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    size_t bytes = mb * 1024 * 1024;
+
+    run("ASCII", makeText(bytes, latin(), false));
+    run("Cyrillic", makeText(bytes, cyrillic(), false));
+    std::vector<std::string> mixed = latin();
+    for (const std::string& c : cyrillic()) mixed.push_back(c);
+    run("mixed", makeText(bytes, mixed, true));
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::ifstream in(argv[i], std::ios::binary);
+        std::string book((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!in.eof() && !in) { std::fprintf(stderr, "cannot read %s\n", argv[i]); return 1; }
+        run(argv[i], book);
+    }
+    return 0;
+}
@@ -1,5 +1,22 @@
 #pragma once
 #define SKIP_ENDS 4
+#define IMAGE_CACHE_BUDGET_MB 128
+#define DISK_CACHE_BUDGET_MB 512
+#define BOOK_CHUNK_KB 1024
+#define SCENE_WORKERS 4
+#define SCENE_QUEUE_LIMIT 16
+#define SCENE_RESOLVE_TIMEOUT_MS 10000
+#define SCENE_CONNECT_TIMEOUT_MS 5000
+#define SCENE_SEND_TIMEOUT_MS 15000
+#define SCENE_RECEIVE_TIMEOUT_MS 90000
+#define SCENE_RETRY_ATTEMPTS 3
+#define SCENE_RETRY_BASE_MS 500
+#define SCENE_RETRY_MAX_MS 8000
+#define SCENE_BREAKER_FAILURES 5
+#define SCENE_BREAKER_COOLDOWN_MS 15000
+#define SCENE_FRAME_RETRY_MS 5000
+#define PREFETCH_MIN_FRAMES 2
+#define PREFETCH_MAX_FRAMES 8
 #define _STYLE_COMMIX "  "
 #define _STYLE_CINEMA "  "
 #define _STYLE_MEME "  "
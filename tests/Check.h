@@ -0,0 +1,20 @@
+﻿#pragma once
+// Check.h — общая обвязка тестов tests/*.cpp: CHECK отмечает проваленное
+// условие (файл, строка, текст) и идёт дальше, Summary в конце main
+// печатает итог и даёт код возврата: 0 — всё прошло.
+#include <cstdio>
+
+namespace manuscripta::test {
+
+    inline int failures = 0;
+
+    inline int Summary()
+    {
+        std::printf(failures ? "%d check(s) failed\n" : "all passed\n", failures);
+        return failures ? 1 : 0;
+    }
+
+} // namespace manuscripta::test
+
+#define CHECK(cond) \
+    do { if (!(cond)) { ++manuscripta::test::failures; std::printf("%s:%d: FAILED %s\n", __FILE__, __LINE__, #cond); } } while (0)
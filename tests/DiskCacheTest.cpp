@@ -0,0 +1,207 @@
+﻿// DiskCacheTest.cpp — проверка DiskCache на временном каталоге:
+// запись/чтение, вытеснение по LRU, переоткрытие с индексом и без,
+// недопустимые ключи, очередь WriteAsync.
+//
+// g++ -O2 -std=c++20 -pthread -I.. DiskCacheTest.cpp ../DiskCache.cpp -o diskcachetest
+// cl /O2 /EHsc /std:c++20 /I.. DiskCacheTest.cpp ..\DiskCache.cpp
+//
+// diskcachetest   (код возврата 0 — всё прошло)
+#include "DiskCache.h"
+#include "Check.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+    // Свой каталог на каждый случай; удаляется в деструкторе
+    struct TempDir
+    {
+        fs::path path;
+        explicit TempDir(const char* name)
+        {
+            path = fs::temp_directory_path() / ("manuscripta-test-" + std::string(name));
+            fs::remove_all(path);
+        }
+        ~TempDir() { std::error_code ec; fs::remove_all(path, ec); }
+    };
+
+    std::string read(manuscripta::DiskCache& cache, const std::string& key)
+    {
+        std::string data;
+        return cache.Read(key, data) ? data : "<missing>";
+    }
+
+    void writeRead()
+    {
+        TempDir dir("rw");
+        manuscripta::DiskCache cache;
+        CHECK(cache.Open(dir.path, 1 << 20));
+        CHECK(cache.IsOpen());
+
+        CHECK(cache.Write("scene-1", "hello"));
+        CHECK(cache.Write("img-2", std::string(1000, 'x')));
+        CHECK(read(cache, "scene-1") == "hello");
+        CHECK(read(cache, "img-2") == std::string(1000, 'x'));
+        CHECK(read(cache, "absent") == "<missing>");
+        CHECK(cache.Count() == 2);
+        CHECK(cache.Bytes() == 1005);
+
+        // перезапись той же записи не раздувает счётчик
+        CHECK(cache.Write("scene-1", "bye"));
+        CHECK(read(cache, "scene-1") == "bye");
+        CHECK(cache.Bytes() == 1003);
+
+        fs::path file;
+        CHECK(cache.Lookup("img-2", file) && fs::file_size(file) == 1000);
+
+        cache.Remove("img-2");
+        CHECK(!cache.Lookup("img-2", file));
+        CHECK(!fs::exists(dir.path / "img-2"));
+        CHECK(cache.Bytes() == 3);
+    }
+
+    void invalidKeys()
+    {
+        TempDir dir("keys");
+        manuscripta::DiskCache cache;
+        CHECK(!cache.Write("a", "closed"));      // кэш ещё не открыт
+        CHECK(cache.Open(dir.path, 1 << 20));
+
+        CHECK(!cache.Write("", "x"));
+        CHECK(!cache.Write("../escape", "x"));
+        CHECK(!cache.Write("a/b", "x"));
+        CHECK(!cache.Write("a.tmp", "x"));
+        CHECK(!cache.Write(std::string(65, 'k'), "x"));
+        CHECK(cache.Write(std::string(64, 'k'), "x"));
+        cache.WriteAsync("bad key", "x");
+        cache.WaitIdle();
+        CHECK(cache.Count() == 1);
+        CHECK(!fs::exists(dir.path.parent_path() / "escape"));
+    }
+
+    void lruTrim()
+    {
+        TempDir dir("lru");
+        manuscripta::DiskCache cache;
+        CHECK(cache.Open(dir.path, 300));
+
+        CHECK(cache.Write("a", std::string(100, 'a')));
+        CHECK(cache.Write("b", std::string(100, 'b')));
+        CHECK(cache.Write("c", std::string(100, 'c')));
+        CHECK(read(cache, "a") != "<missing>");  // a свежее b
+
+        CHECK(cache.Write("d", std::string(100, 'd')));
+        fs::path file;
+        CHECK(!cache.Lookup("b", file));          // самая давняя — b
+        CHECK(!fs::exists(dir.path / "b"));
+        CHECK(cache.Lookup("a", file) && cache.Lookup("c", file) && cache.Lookup("d", file));
+        CHECK(cache.Bytes() == 300);
+
+        cache.SetCapacity(150);                   // остаётся одна, последняя тронутая
+        CHECK(cache.Count() == 1 && cache.Lookup("d", file));
+
+        // запись больше всего лимита не остаётся
+        CHECK(cache.Write("huge", std::string(200, 'h')));
+        CHECK(cache.Bytes() <= 150);
+    }
+
+    void reopen()
+    {
+        TempDir dir("reopen");
+        {
+            manuscripta::DiskCache cache;
+            CHECK(cache.Open(dir.path, 250));
+            CHECK(cache.Write("old", std::string(100, 'o')));
+            CHECK(cache.Write("new", std::string(100, 'n')));
+            CHECK(read(cache, "old") == std::string(100, 'o'));  // теперь old свежее
+        }   // деструктор сохраняет индекс
+
+        CHECK(fs::exists(dir.path / "index.txt"));
+        {
+            manuscripta::DiskCache cache;
+            CHECK(cache.Open(dir.path, 250));
+            CHECK(cache.Count() == 2 && cache.Bytes() == 200);
+            CHECK(read(cache, "new") == std::string(100, 'n'));
+
+            // отметки обращений пережили переоткрытие: вытесняется old
+            CHECK(cache.Write("third", std::string(100, 't')));
+            fs::path file;
+            CHECK(!cache.Lookup("old", file));
+            CHECK(cache.Lookup("new", file));
+        }
+
+        // файл без индекса (упали до сохранения) и недописанный *.tmp
+        { std::ofstream(dir.path / "orphan", std::ios::binary) << "orphan"; }
+        { std::ofstream(dir.path / "w7.tmp", std::ios::binary) << "partial"; }
+        fs::remove(dir.path / "index.txt");
+        {
+            manuscripta::DiskCache cache;
+            CHECK(cache.Open(dir.path, 1 << 20));
+            CHECK(read(cache, "orphan") == "orphan");
+            CHECK(read(cache, "new") == std::string(100, 'n'));
+            CHECK(!fs::exists(dir.path / "w7.tmp"));
+        }
+    }
+
+    void asyncWrites()
+    {
+        TempDir dir("async");
+        {
+            manuscripta::DiskCache cache;
+            CHECK(cache.Open(dir.path, 1 << 20));
+            for (int i = 0; i < 100; ++i)
+                cache.WriteAsync("k" + std::to_string(i), std::to_string(i));
+            CHECK(read(cache, "k42") == "42");   // видна до записи на диск
+            cache.WaitIdle();
+            CHECK(cache.Count() == 100);
+        }
+        manuscripta::DiskCache cache;
+        CHECK(cache.Open(dir.path, 1 << 20));
+        CHECK(cache.Count() == 100 && read(cache, "k99") == "99");
+    }
+
+    // Индекс не переписывается на каждую запись: время на запись не
+    // растёт с размером кэша
+    void manyWrites()
+    {
+        TempDir dir("many");
+        manuscripta::DiskCache cache;
+        CHECK(cache.Open(dir.path, uint64_t(1) << 30));
+
+        double batch[2] = {};
+        for (int b = 0; b < 4; ++b)
+        {
+            const auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < 2000; ++i)
+                cache.Write("scene-" + std::to_string(b * 2000 + i), "payload");
+            const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if (b == 0) batch[0] = s;
+            if (b == 3) batch[1] = s;
+        }
+        std::printf("2000 writes: %.3f s first batch, %.3f s at 6000 entries\n", batch[0], batch[1]);
+        CHECK(batch[1] < batch[0] * 3 + 0.5);
+        CHECK(cache.Count() == 8000);
+
+        cache.Flush();
+        manuscripta::DiskCache again;
+        CHECK(again.Open(dir.path, uint64_t(1) << 30));
+        CHECK(again.Count() == 8000);
+    }
+
+} // namespace
+
+int main()
+{
+    writeRead();
+    invalidKeys();
+    lruTrim();
+    reopen();
+    asyncWrites();
+    manyWrites();
+    return manuscripta::test::Summary();
+}
@@ -0,0 +1,166 @@
+﻿// ImageScalerTest.cpp — Ланцош-3 на «сырых» буферах: SSE2 и скаляр
+// дают одни и те же пиксели, однотонная картинка остаётся однотонной,
+// масштаб 1 — тождество, запись не выходит за пределы dst на краях и
+// нечётных размерах (stride шире строки, сторожевые пиксели вокруг).
+//
+// g++ -O2 -std=c++20 -I.. ImageScalerTest.cpp ../ImageScaler.cpp -o imagescalertest
+// cl /O2 /EHsc /std:c++20 /I.. ImageScalerTest.cpp ..\ImageScaler.cpp
+// (выход за пределы src ловит -fsanitize=address)
+//
+// imagescalertest   (код возврата 0 — всё прошло)
+#include "ImageScaler.h"
+#include "Check.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+    const uint32_t GUARD = 0xDEADBEEF;
+
+    // Картинка с запасом: PAD сторожевых строк сверху и снизу, stride
+    // шире ширины — всё, что вне [width x height], должно остаться GUARD
+    struct Image
+    {
+        static constexpr int PAD = 2;
+        std::vector<uint32_t> storage;
+        int width, height;
+        size_t stride;
+
+        Image(int w, int h) : width(w), height(h), stride(size_t(w) + 3)
+        {
+            storage.assign(stride * (size_t(h) + 2 * PAD), GUARD);
+        }
+        uint32_t* row(int y) { return storage.data() + stride * size_t(y + PAD); }
+        uint32_t& at(int x, int y) { return row(y)[x]; }
+
+        manuscripta::PixelBuffer buffer() { return { row(0), width, height, stride }; }
+        manuscripta::ConstPixelBuffer constBuffer() { return { row(0), width, height, stride }; }
+
+        bool guardsIntact() const
+        {
+            for (size_t i = 0; i < storage.size(); ++i)
+            {
+                const long y = long(i / stride) - PAD;
+                const size_t x = i % stride;
+                const bool inside = y >= 0 && y < height && x < size_t(width);
+                if (!inside && storage[i] != GUARD) return false;
+            }
+            return true;
+        }
+    };
+
+    // Источник ровно по размеру (без запаса): чтение за краем — ASan
+    struct Source
+    {
+        std::vector<uint32_t> pixels;
+        int width, height;
+
+        Source(int w, int h, uint32_t seed) : pixels(size_t(w) * h), width(w), height(h)
+        {
+            std::mt19937 rng(seed);
+            for (uint32_t& p : pixels) p = rng();
+        }
+        manuscripta::ConstPixelBuffer buffer() const { return { pixels.data(), width, height, size_t(width) }; }
+    };
+
+    int channelDiff(uint32_t a, uint32_t b)
+    {
+        int worst = 0;
+        for (int c = 0; c < 32; c += 8)
+            worst = std::max(worst, std::abs(int((a >> c) & 0xFF) - int((b >> c) & 0xFF)));
+        return worst;
+    }
+
+    const int SIZES[][4] = {
+        { 1, 1, 1, 1 }, { 1, 1, 7, 5 }, { 3, 17, 1, 1 }, { 13, 7, 5, 11 },
+        { 64, 48, 33, 25 }, { 33, 25, 64, 48 }, { 1000, 3, 7, 2 }, { 2, 999, 3, 4 },
+        { 101, 77, 99, 79 }, { 640, 480, 1280, 960 }, { 1280, 960, 317, 239 },
+    };
+
+    void simdMatchesScalar()
+    {
+        uint32_t seed = 1;
+        for (const auto& s : SIZES)
+        {
+            const Source src(s[0], s[1], seed++);
+            Image simd(s[2], s[3]), scalar(s[2], s[3]);
+            CHECK(manuscripta::resampleLanczos3(src.buffer(), simd.buffer()));
+            CHECK(manuscripta::resampleLanczos3Scalar(src.buffer(), scalar.buffer()));
+            CHECK(simd.guardsIntact() && scalar.guardsIntact());
+
+            int worst = 0;
+            for (int y = 0; y < s[3]; ++y)
+                for (int x = 0; x < s[2]; ++x)
+                    worst = std::max(worst, channelDiff(simd.at(x, y), scalar.at(x, y)));
+            if (worst > 0)
+                std::printf("%dx%d -> %dx%d: SSE2 vs scalar differ by %d\n", s[0], s[1], s[2], s[3], worst);
+            CHECK(worst <= 1);          // порядок сложения один и тот же
+        }
+    }
+
+    void constantStaysConstant()
+    {
+        for (uint32_t color : { 0x00000000u, 0xFFFFFFFFu, 0x80402010u, 0xFF7F01FEu })
+            for (const auto& s : SIZES)
+            {
+                Source src(s[0], s[1], 0);
+                for (uint32_t& p : src.pixels) p = color;
+                for (auto resample : { manuscripta::resampleLanczos3, manuscripta::resampleLanczos3Scalar })
+                {
+                    Image dst(s[2], s[3]);
+                    CHECK(resample(src.buffer(), dst.buffer()));
+                    bool same = true;
+                    for (int y = 0; y < s[3]; ++y)
+                        for (int x = 0; x < s[2]; ++x)
+                            same = same && dst.at(x, y) == color;
+                    CHECK(same);
+                    CHECK(dst.guardsIntact());
+                }
+            }
+    }
+
+    void identityAtScaleOne()
+    {
+        for (const auto& s : SIZES)
+        {
+            const Source src(s[0], s[1], 99);
+            for (auto resample : { manuscripta::resampleLanczos3, manuscripta::resampleLanczos3Scalar })
+            {
+                Image dst(s[0], s[1]);
+                CHECK(resample(src.buffer(), dst.buffer()));
+                bool same = true;
+                for (int y = 0; y < s[1]; ++y)
+                    for (int x = 0; x < s[0]; ++x)
+                        same = same && dst.at(x, y) == src.pixels[size_t(y) * s[0] + x];
+                CHECK(same);
+                CHECK(dst.guardsIntact());
+            }
+        }
+    }
+
+    void rejectsEmpty()
+    {
+        const Source src(4, 4, 3);
+        Image dst(4, 4);
+        manuscripta::PixelBuffer none = dst.buffer();
+        none.width = 0;
+        CHECK(!manuscripta::resampleLanczos3(src.buffer(), none));
+        manuscripta::ConstPixelBuffer nothing = src.buffer();
+        nothing.pixels = nullptr;
+        CHECK(!manuscripta::resampleLanczos3Scalar(nothing, dst.buffer()));
+        CHECK(dst.guardsIntact() && dst.at(0, 0) == GUARD);
+    }
+
+} // namespace
+
+int main()
+{
+    simdMatchesScalar();
+    constantStaysConstant();
+    identityAtScaleOne();
+    rejectsEmpty();
+    return manuscripta::test::Summary();
+}
@@ -0,0 +1,177 @@
+﻿// TextLayoutTest.cpp — перенос строк TextLayout на синтетической
+// таблице ширин (без HDC): слова, слово длиннее строки, жёсткие
+// переводы строк, символы вне BMP и дописывание по одному символу.
+//
+// g++ -O2 -std=c++20 -I.. TextLayoutTest.cpp ../TextLayout.cpp -o textlayouttest
+// cl /O2 /EHsc /std:c++20 /I.. TextLayoutTest.cpp ..\TextLayout.cpp
+// На Linux суррогатные пары (wchar_t в 16 бит, как на Windows) — с
+// -fshort-wchar: тест обходится без wcs*-функций libc.
+//
+// textlayouttest   (код возврата 0 — всё прошло)
+#include "TextLayout.h"
+#include "Check.h"
+#include <string>
+#include <vector>
+
+namespace {
+
+    // Ширины: буква 10, пробел 5, табуляция 20, символ вне BMP 30
+    int advance(char32_t cp)
+    {
+        if (cp == U' ') return 5;
+        if (cp == U'\t') return 20;
+        if (cp > 0xFFFF) return 30;
+        return 10;
+    }
+
+    // Текст кадра в единицах wchar_t: вне BMP — пара при 16-битном wchar_t
+    std::vector<wchar_t> units(const std::u32string& s)
+    {
+        std::vector<wchar_t> out;
+        for (char32_t cp : s)
+        {
+            if (sizeof(wchar_t) == 2 && cp > 0xFFFF) {
+                cp -= 0x10000;
+                out.push_back(wchar_t(0xD800 + (cp >> 10)));
+                out.push_back(wchar_t(0xDC00 + (cp & 0x3FF)));
+            }
+            else out.push_back(wchar_t(cp));
+        }
+        return out;
+    }
+
+    // Строки раскладки обратно в текст (без '\n'), чтобы сравнивать глазами
+    std::vector<std::u32string> lines(const manuscripta::TextLayout& layout, const std::u32string& s)
+    {
+        // индекс единицы → индекс символа
+        std::vector<size_t> unitToChar;
+        for (size_t c = 0; c < s.size(); ++c) {
+            unitToChar.push_back(c);
+            if (sizeof(wchar_t) == 2 && s[c] > 0xFFFF) unitToChar.push_back(c);
+        }
+        unitToChar.push_back(s.size());
+
+        std::vector<std::u32string> out;
+        for (size_t i = 0; i < layout.LineCount(); ++i) {
+            const manuscripta::LayoutLine& l = layout.Line(i);
+            out.push_back(s.substr(unitToChar[l.start], unitToChar[l.end] - unitToChar[l.start]));
+        }
+        return out;
+    }
+
+    std::vector<std::u32string> wrap(const std::u32string& s, int width)
+    {
+        const std::vector<wchar_t> text = units(s);
+        manuscripta::TextLayout layout;
+        layout.Reset(width, 16);
+        layout.Extend(text.data(), text.size(), advance);
+        CHECK(layout.Laid() == text.size());
+        return lines(layout, s);
+    }
+
+    using Lines = std::vector<std::u32string>;
+
+    void wordBreaks()
+    {
+        // "aaa bbb " = 70: следующая буква уже не влезает в 75
+        CHECK(wrap(U"aaa bbb ccc", 75) == (Lines{ U"aaa bbb ", U"ccc" }));
+        // пробелы висят за краем строки и не переносятся
+        CHECK(wrap(U"aaa   bbb", 30) == (Lines{ U"aaa   ", U"bbb" }));
+        // ровно по ширине — без переноса
+        CHECK(wrap(U"aaaa", 40) == (Lines{ U"aaaa" }));
+        CHECK(wrap(U"aa bbb", 55) == (Lines{ U"aa bbb" }));
+        CHECK(wrap(U"aa bbb", 54) == (Lines{ U"aa ", U"bbb" }));
+        CHECK(wrap(U"aa bb cc dd", 50) == (Lines{ U"aa bb ", U"cc dd" }));
+        // табуляция — тоже место переноса
+        CHECK(wrap(U"aa\tbbbb", 50) == (Lines{ U"aa\t", U"bbbb" }));
+    }
+
+    void overlongWords()
+    {
+        CHECK(wrap(U"abcdefghij", 35) == (Lines{ U"abc", U"def", U"ghi", U"j" }));
+        // длинное слово после короткого: сначала перенос слова, потом нарезка
+        CHECK(wrap(U"ab cdefghij", 40) == (Lines{ U"ab ", U"cdef", U"ghij" }));
+        // строка уже любого символа — по символу в строке, без пустых строк
+        CHECK(wrap(U"abc", 5) == (Lines{ U"a", U"b", U"c" }));
+    }
+
+    void hardBreaks()
+    {
+        CHECK(wrap(U"ab\ncd", 100) == (Lines{ U"ab", U"cd" }));
+        CHECK(wrap(U"ab\r\ncd", 100) == (Lines{ U"ab\r", U"cd" }));
+        CHECK(wrap(U"ab\n\ncd", 100) == (Lines{ U"ab", U"", U"cd" }));
+        CHECK(wrap(U"abcd\nef", 25) == (Lines{ U"ab", U"cd", U"ef" }));
+
+        manuscripta::TextLayout layout;
+        layout.Reset(100, 16);
+        CHECK(layout.Height() == 0);
+        const std::vector<wchar_t> text = units(U"a\nb\nc");
+        layout.Extend(text.data(), text.size(), advance);
+        CHECK(layout.LineCount() == 3 && layout.Height() == 48);
+    }
+
+    void beyondBmp()
+    {
+        const char32_t book = 0x1F4D6;
+        const std::u32string s = std::u32string(U"ab") + book + U"cd";
+        // символ вне BMP — одна ширина (30), а не две половины пары
+        CHECK(wrap(s, 70) == (Lines{ s }));
+        CHECK(wrap(s, 45) == (Lines{ std::u32string(U"ab"), std::u32string(1, book) + U"c", U"d" }));
+        // пара не разрывается даже посимвольной нарезкой
+        const std::u32string three(3, book);
+        CHECK(wrap(three, 40) == (Lines{ std::u32string(1, book), std::u32string(1, book), std::u32string(1, book) }));
+        CHECK(wrap(std::u32string(U"xx ") + book + book, 65) ==
+            (Lines{ U"xx ", std::u32string(2, book) }));
+    }
+
+    // Дописывание по одной единице даёт ту же раскладку, что и разом;
+    // незаконченная пара не раскладывается до второй половины
+    void incremental()
+    {
+        const char32_t book = 0x1F4D6;
+        const std::u32string s = std::u32string(U"one two ") + book + U" three\nfour fivesixseveneight " +
+            book + book + U" nine";
+        const std::vector<wchar_t> text = units(s);
+
+        for (int width : { 15, 40, 75, 120, 1000 })
+        {
+            manuscripta::TextLayout once;
+            once.Reset(width, 16);
+            once.Extend(text.data(), text.size(), advance);
+
+            manuscripta::TextLayout grown;
+            grown.Reset(width, 16);
+            bool dirtyOk = true;
+            for (size_t n = 1; n <= text.size(); ++n)
+            {
+                const size_t linesBefore = grown.LineCount();
+                grown.ClearDirty();
+                grown.Extend(text.data(), n, advance);
+
+                const bool highHalf = sizeof(wchar_t) == 2 && text[n - 1] >= 0xD800 && text[n - 1] <= 0xDBFF;
+                if (grown.Laid() != (highHalf ? n - 1 : n)) dirtyOk = false;
+                // изменения — не раньше предпоследней строки прошлого тика
+                if (grown.Laid() == n && grown.FirstDirtyLine() + 2 < linesBefore) dirtyOk = false;
+            }
+            CHECK(dirtyOk);
+            CHECK(lines(grown, s) == lines(once, s));
+            CHECK(grown.Height() == once.Height());
+
+            // повтор с тем же count ничего не меняет
+            grown.ClearDirty();
+            grown.Extend(text.data(), text.size(), advance);
+            CHECK(grown.FirstDirtyLine() == manuscripta::TextLayout::npos);
+        }
+    }
+
+} // namespace
+
+int main()
+{
+    wordBreaks();
+    overlongWords();
+    hardBreaks();
+    beyondBmp();
+    incremental();
+    return manuscripta::test::Summary();
+}
@@ -0,0 +1,27 @@
+﻿// PrewarmCli.cpp — пакетная подготовка сцен книги на Linux (без окна и GDI+).
+// Картинки скачиваются в DiskCache как есть; декодирует их читалка.
+//
+// g++ -O2 -std=c++20 -pthread -I.. PrewarmCli.cpp ../Prewarm.cpp ../SceneFetcher.cpp ../HttpClient.cpp ../HttpClientPosix.cpp ../DiskCache.cpp ../WorkerPool.cpp ../CancelToken.cpp ../ParagraphIndex.cpp ../NewlineScan.cpp ../FileLoader.cpp ../Utf8.cpp ../CircuitBreaker.cpp ../MappedFile.cpp -o prewarm
+//
+// prewarm --prewarm book.txt [--concurrency N] [--server 127.0.0.1:8080] [--cache dir]
+#include "Prewarm.h"
+#include "Utf8.h"
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    std::vector<std::wstring> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::wstring w;
+        if (!manuscripta::utf8ToWide(argv[i], w))
+            w = manuscripta::cp1251ToWide(argv[i]);
+        args.push_back(std::move(w));
+    }
+    // без флага — первый аргумент считается книгой
+    if (!args.empty() && !manuscripta::isPrewarmCommand(args))
+        args.insert(args.begin(), L"--prewarm");
+
+    return manuscripta::prewarmMain(args, manuscripta::diskImageStage);
+}
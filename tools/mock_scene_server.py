@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+# mock_scene_server.py — локальная замена сервера сцен для тестов и
+# бенчмарков без сети.  Только стандартная библиотека Python 3.
+#
+#   POST /api/scene/getScene   {"text_chunk": "..."} → JSON со ссылкой на картинку
+#   GET  /images/<id>.<ext>    картинка (файл --image или сгенерированный BMP)
+#   GET  /stats                счётчики запросов и внесённых сбоев
+#
+# Задержки и сбои вносятся случайно (--seed — воспроизводимо):
+#   python3 tools/mock_scene_server.py --port 8080 --scene-latency 800 \
+#       --scene-jitter 300 --error-rate 0.02 --drop-rate 0.01
+#
+# Читалка/prewarm/бенчмарк направляются сюда через --server 127.0.0.1:8080.
+import argparse
+import hashlib
+import json
+import random
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+SCENE_PATH = "/api/scene/getScene"
+DEFAULT_SCENE_JSON = '{"data": {"image": "$IMAGE_URL"}}'
+
+
+def make_bmp(width, height):
+    """24-битный BMP с градиентом — GDI+ декодирует его как настоящую картинку."""
+    row = bytearray()
+    for x in range(width):
+        row += bytes((x * 255 // max(1, width - 1), 96, 160))
+    row += b"\0" * ((4 - len(row) % 4) % 4)
+    pixels = bytearray()
+    for y in range(height):
+        shade = y * 255 // max(1, height - 1)
+        line = bytearray(row)
+        line[1:width * 3:3] = bytes([shade]) * width
+        pixels += line
+    header = struct.pack("<2sIHHI", b"BM", 54 + len(pixels), 0, 0, 54)
+    info = struct.pack("<IiiHHIIiiII", 40, width, height, 1, 24, 0, len(pixels), 2835, 2835, 0, 0)
+    return header + info + bytes(pixels)
+
+
+class Faults:
+    """Случайные задержки и сбои; общий генератор под замком."""
+
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.lock = threading.Lock()
+        self.counters = {
+            "scene_requests": 0, "image_requests": 0,
+            "errors": 0, "drops": 0, "bad_json": 0, "empty": 0, "image_errors": 0,
+        }
+
+    def count(self, name):
+        with self.lock:
+            self.counters[name] += 1
+
+    def roll(self):
+        with self.lock:
+            return self.rng.random()
+
+    def delay(self, mean_ms, jitter_ms):
+        with self.lock:
+            ms = mean_ms + (self.rng.uniform(-jitter_ms, jitter_ms) if jitter_ms else 0)
+        if ms > 0:
+            time.sleep(ms / 1000.0)
+
+    def snapshot(self):
+        with self.lock:
+            return dict(self.counters)
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"          # keep-alive, как у настоящего сервера
+    server_version = "MockScene/1.0"
+
+    def log_message(self, fmt, *args):
+        if self.server.args.verbose:
+            super().log_message(fmt, *args)
+
+    def reply(self, code, body, content_type):
+        self.send_response(code)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def drop(self):
+        # оборвать соединение без ответа
+        self.close_connection = True
+
+    def do_POST(self):
+        srv = self.server
+        length = int(self.headers.get("Content-Length", 0) or 0)
+        raw = self.rfile.read(length)
+        if self.path != SCENE_PATH:
+            self.reply(404, b'{"error": "not found"}', "application/json")
+            return
+        srv.faults.count("scene_requests")
+        try:
+            text = json.loads(raw.decode("utf-8"))["text_chunk"]
+        except (ValueError, KeyError, TypeError):
+            self.reply(400, b'{"error": "bad request"}', "application/json")
+            return
+
+        a = srv.args
+        srv.faults.delay(a.scene_latency, a.scene_jitter)
+
+        # один бросок на запрос: доли сбоев не перекрываются
+        r = srv.faults.roll()
+        for name, rate in (("drops", a.drop_rate), ("errors", a.error_rate),
+                           ("bad_json", a.bad_json_rate), ("empty", a.empty_rate)):
+            if r < rate:
+                srv.faults.count(name)
+                if name == "drops":
+                    self.drop()
+                elif name == "errors":
+                    self.reply(500, b'{"error": "injected failure"}', "application/json")
+                elif name == "bad_json":
+                    self.reply(200, b'{"data": {"image": ', "application/json")
+                else:
+                    self.reply(200, b'{"data": {}}', "application/json")
+                return
+            r -= rate
+
+        key = hashlib.sha1(text.encode("utf-8")).hexdigest()[:16]
+        host = self.headers.get("Host") or "127.0.0.1:%d" % srv.server_port
+        url = "http://%s/images/%s.%s" % (host, key, srv.image_ext)
+        body = srv.scene_json.replace("$IMAGE_URL", url).encode("utf-8")
+        self.reply(200, body, "application/json")
+
+    def do_GET(self):
+        srv = self.server
+        if self.path == "/stats":
+            self.reply(200, json.dumps(srv.faults.snapshot()).encode(), "application/json")
+            return
+        if not self.path.startswith("/images/"):
+            self.reply(404, b"not found", "text/plain")
+            return
+
+        a = srv.args
+        srv.faults.count("image_requests")
+        srv.faults.delay(a.image_latency, a.image_jitter)
+        if srv.faults.roll() < a.image_error_rate:
+            srv.faults.count("image_errors")
+            self.reply(503, b"injected failure", "text/plain")
+            return
+        self.reply(200, srv.image, srv.image_type)
+
+
+def main():
+    p = argparse.ArgumentParser(description="Local stand-in for the scene API")
+    p.add_argument("--host", default="127.0.0.1")
+    p.add_argument("--port", type=int, default=8080)
+    p.add_argument("--scene-latency", type=float, default=0, help="ms before a scene reply")
+    p.add_argument("--scene-jitter", type=float, default=0, help="± ms, uniform")
+    p.add_argument("--image-latency", type=float, default=0, help="ms before an image reply")
+    p.add_argument("--image-jitter", type=float, default=0)
+    p.add_argument("--error-rate", type=float, default=0, help="scene replies 500")
+    p.add_argument("--drop-rate", type=float, default=0, help="scene connections closed unanswered")
+    p.add_argument("--bad-json-rate", type=float, default=0, help="scene replies truncated JSON")
+    p.add_argument("--empty-rate", type=float, default=0, help="scene replies without an image")
+    p.add_argument("--image-error-rate", type=float, default=0, help="image replies 503")
+    p.add_argument("--scene-json", help="reply template; $IMAGE_URL is replaced")
+    p.add_argument("--image", help="image file to serve (default: generated BMP)")
+    p.add_argument("--image-size", default="512x512", help="WxH of the generated BMP")
+    p.add_argument("--seed", type=int, default=None)
+    p.add_argument("--verbose", action="store_true")
+    args = p.parse_args()
+
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    server.daemon_threads = True
+    server.args = args
+    server.faults = Faults(args)
+
+    if args.scene_json:
+        with open(args.scene_json, encoding="utf-8") as f:
+            server.scene_json = f.read()
+    else:
+        server.scene_json = DEFAULT_SCENE_JSON
+
+    if args.image:
+        with open(args.image, "rb") as f:
+            server.image = f.read()
+        ext = args.image.rsplit(".", 1)[-1].lower() if "." in args.image else "bin"
+        server.image_ext = ext
+        server.image_type = {"png": "image/png", "jpg": "image/jpeg", "jpeg": "image/jpeg",
+                             "bmp": "image/bmp", "gif": "image/gif"}.get(ext, "application/octet-stream")
+    else:
+        w, h = (int(v) for v in args.image_size.lower().split("x"))
+        server.image = make_bmp(w, h)
+        server.image_ext = "bmp"
+        server.image_type = "image/bmp"
+
+    print("mock scene server on http://%s:%d%s (image %d bytes)"
+          % (args.host, server.server_port, SCENE_PATH, len(server.image)), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print(json.dumps(server.faults.snapshot()), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()